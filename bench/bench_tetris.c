@@ -0,0 +1,394 @@
+/**
+ * Microbenchmarks for the tetris game library hot paths
+ * @file bench_tetris.c
+ * @brief Times tg_tick, check_valid_move, test_piece_rotate, check_and_clear_rows,
+ *  clear_rows, render_active_board and find_placements on generated boards and on the saved
+ *  game states in test/files/. Each benchmark runs warmup repetitions, then
+ *  times repetitions of a fixed number of ops and reports ns/op percentiles
+ *  across repetitions. Results can also be written as CSV for tracking
+ *  regressions between releases.
+ *
+ * Usage: bench_tetris [-r reps] [-n ops_per_rep] [-w warmup_reps]
+ *                     [-d fixture_dir] [-o results.csv]
+ */
+
+#include <dirent.h>     // listing fixture files
+#include <unistd.h>     // getopt
+#include <time.h>
+
+#include "tetris.h"
+#include "tetris_placement.h"
+#include "utils.h"
+
+
+#define BENCH_DEFAULT_REPS 50
+#define BENCH_DEFAULT_OPS 10000
+#define BENCH_DEFAULT_WARMUP 5
+#define BENCH_DEFAULT_FIXTURE_DIR "./test/files"
+
+#define BENCH_MAX_BOARDS 32
+// tg_tick puts the game back every this many ticks (about 3 gravity steps 
+//  on the 10ms frame clock), so every op ticks a game near the board it 
+//  started from instead of one that drifted or topped out long ago
+#define BENCH_TICK_RESTORE_OPS 64
+#define BENCH_MAX_NAME_LEN 96
+
+/**
+ * Board a benchmark runs against
+ * @param name board name for the report
+ * @param game game state every repetition starts from
+*/
+typedef struct bench_board {
+    char name[BENCH_MAX_NAME_LEN];
+    TetrisGame game;
+} bench_board;
+
+/**
+ * State handed to a benchmark op loop
+ * @param tmpl game state to start from
+ * @param work game state the ops run on, reset from tmpl before every repetition
+ * @param tp_cells global cells of tmpl's active piece
+*/
+typedef struct bench_ctx {
+    const TetrisGame *tmpl;
+    TetrisGame work;
+    tetris_location tp_cells[NUM_CELLS_IN_TETROMINO];
+} bench_ctx;
+
+typedef uint32_t (*bench_fn)(bench_ctx *ctx, uint32_t ops);
+
+typedef struct bench_case {
+    const char *name;
+    bench_fn fn;
+} bench_case;
+
+// results are summed into here so the compiler can't drop the calls
+static volatile uint32_t bench_sink;
+
+
+/////////////// BENCHMARKED OPS ////////////////
+
+/**
+ * Copying the board back from the template, which the mutating
+ * benchmarks below do every op. Subtract this from their numbers
+*/
+static uint32_t bench_board_restore(bench_ctx *ctx, uint32_t ops) {
+    uint32_t acc = 0;
+    for (uint32_t i = 0; i < ops; i++) {
+        ctx->work.board = ctx->tmpl->board;
+        acc += ctx->work.board.highest_occupied_cell;
+    }
+    return acc;
+}
+
+/**
+ * Copying the whole game back from the template every BENCH_TICK_RESTORE_OPS
+ * ops, as tg_tick does. Subtract this from its numbers
+*/
+static uint32_t bench_game_restore(bench_ctx *ctx, uint32_t ops) {
+    uint32_t acc = 0;
+    for (uint32_t i = 0; i < ops; i++) {
+        if (i % BENCH_TICK_RESTORE_OPS == 0)
+            ctx->work = *ctx->tmpl;
+        acc += ctx->work.game_over;
+    }
+    return acc;
+}
+
+static uint32_t bench_tg_tick(bench_ctx *ctx, uint32_t ops) {
+    uint32_t acc = 0;
+    for (uint32_t i = 0; i < ops; i++) {
+        if (i % BENCH_TICK_RESTORE_OPS == 0)
+            ctx->work = *ctx->tmpl;
+        acc += tg_tick(&ctx->work, T_NONE);
+    }
+    return acc;
+}
+
+static uint32_t bench_check_valid_move(bench_ctx *ctx, uint32_t ops) {
+    static const enum player_move moves[3] = {T_LEFT, T_RIGHT, T_DOWN};
+    uint32_t acc = 0;
+    for (uint32_t i = 0; i < ops; i++) {
+        acc += check_valid_move(&ctx->work, moves[i % 3]);
+    }
+    return acc;
+}
+
+static uint32_t bench_test_piece_rotate(bench_ctx *ctx, uint32_t ops) {
+    uint32_t acc = 0;
+    TetrisPiece tp = ctx->work.active_piece;
+    for (uint32_t i = 0; i < ops; i++) {
+        tp.orientation = i % NUM_ORIENTATIONS;
+        acc += test_piece_rotate(&ctx->work.board, tp);
+    }
+    return acc;
+}
+
+static uint32_t bench_check_and_clear_rows(bench_ctx *ctx, uint32_t ops) {
+    uint32_t acc = 0;
+    for (uint32_t i = 0; i < ops; i++) {
+        ctx->work.board = ctx->tmpl->board;
+        acc += check_and_clear_rows(&ctx->work, ctx->tp_cells);
+    }
+    return acc;
+}
+
+static uint32_t bench_clear_rows(bench_ctx *ctx, uint32_t ops) {
+    uint32_t acc = 0;
+    for (uint32_t i = 0; i < ops; i++) {
+        ctx->work.board = ctx->tmpl->board;
+        clear_rows(&ctx->work, TETRIS_ROWS - 4, 2);
+        acc += ctx->work.board.highest_occupied_cell;
+    }
+    return acc;
+}
+
+static uint32_t bench_render_active_board(bench_ctx *ctx, uint32_t ops) {
+    uint32_t acc = 0;
+    for (uint32_t i = 0; i < ops; i++) {
+        render_active_board(&ctx->work);
+        acc += ctx->work.active_board.highest_occupied_cell;
+    }
+    return acc;
+}
+
+static uint32_t bench_find_placements(bench_ctx *ctx, uint32_t ops) {
+    static TetrisPlacementList pl;
+    uint32_t acc = 0;
+    for (uint32_t i = 0; i < ops; i++) {
+        acc += find_placements(&ctx->work.board, i % NUM_TETROMINOS, &pl);
+    }
+    return acc;
+}
+
+static const bench_case bench_cases[] = {
+    {"board_restore", bench_board_restore},
+    {"game_restore", bench_game_restore},
+    {"tg_tick", bench_tg_tick},
+    {"check_valid_move", bench_check_valid_move},
+    {"test_piece_rotate", bench_test_piece_rotate},
+    {"check_and_clear_rows", bench_check_and_clear_rows},
+    {"clear_rows", bench_clear_rows},
+    {"render_active_board", bench_render_active_board},
+    {"find_placements", bench_find_placements},
+};
+
+
+/////////////// BOARD SETUP ////////////////
+
+/**
+ * Common setup for every bench board: frame clock so tg_tick runs
+ * at full speed, and a deterministic piece sequence
+*/
+static void bench_prepare_game(TetrisGame *tg) {
+    tg_seed_rng(tg, 1);
+    tg_set_frame_clock(tg, 10000);
+}
+
+/**
+ * Generated board: `stack_rows` incomplete rows at the bottom,
+ * piece at its spawn location
+*/
+static void bench_generated_board(bench_board *bb, const char *name, uint8_t stack_rows) {
+    TetrisGame *tg = create_game_seeded(1);
+    bench_prepare_game(tg);
+
+    for (int r = TETRIS_ROWS - stack_rows; r < TETRIS_ROWS; r++) {
+        for (int c = 0; c < TETRIS_COLS; c++) {
+            // leave one hole per row, walking across the board
+            if (c != r % TETRIS_COLS)
+                tg->board.board[r][c] = r % NUM_TETROMINOS;
+        }
+    }
+    if (stack_rows > 0)
+        tg->board.highest_occupied_cell = TETRIS_ROWS - stack_rows;
+    rebuild_board_occupancy(&tg->board);
+
+    create_rand_piece(tg);
+    render_active_board(tg);
+
+    snprintf(bb->name, BENCH_MAX_NAME_LEN, "%s", name);
+    bb->game = *tg;
+    end_game(tg);
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/**
+ * Load every .ini saved game in `dir` as a bench board
+ * @returns number of boards loaded
+*/
+static int bench_load_fixtures(bench_board *boards, int max_boards, const char *dir) {
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        fprintf(stderr, "can't open fixture dir %s, only using generated boards\n", dir);
+        return 0;
+    }
+
+    // sort names so board order is stable between runs
+    char *names[BENCH_MAX_BOARDS];
+    int num_names = 0;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL && num_names < max_boards) {
+        size_t len = strlen(ent->d_name);
+        if (len > 4 && strcmp(ent->d_name + len - 4, ".ini") == 0)
+            names[num_names++] = strdup(ent->d_name);
+    }
+    closedir(d);
+    qsort(names, num_names, sizeof(char*), cmp_str);
+
+    int loaded = 0;
+    char path[512];
+    for (int i = 0; i < num_names; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+
+        TetrisGame *tg = create_game_seeded(1);
+        if (restore_game_state(tg, path, stderr)) {
+            bench_prepare_game(tg);
+            snprintf(boards[loaded].name, BENCH_MAX_NAME_LEN, "%s", names[i]);
+            boards[loaded].game = *tg;
+            loaded++;
+        }
+        end_game(tg);
+        free(names[i]);
+    }
+    return loaded;
+}
+
+
+/////////////// TIMING ////////////////
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Run one benchmark on one board, print a report line, and
+ * append a CSV row if `csv` is set
+*/
+static void bench_run(const bench_case *bc, const bench_board *bb, uint32_t reps, \
+    uint32_t ops, uint32_t warmup, FILE *csv) {
+
+    bench_ctx ctx = {.tmpl = &bb->game};
+    TetrisPiece tp = bb->game.active_piece;
+    for (int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
+        ctx.tp_cells[i].row = tp.loc.row + TETROMINOS[tp.ptype][tp.orientation][i].row;
+        ctx.tp_cells[i].col = tp.loc.col + TETROMINOS[tp.ptype][tp.orientation][i].col;
+    }
+
+    double *ns_per_op = malloc(reps * sizeof(double));
+    for (uint32_t r = 0; r < warmup + reps; r++) {
+        ctx.work = bb->game;
+
+        uint64_t start = now_ns();
+        bench_sink += bc->fn(&ctx, ops);
+        uint64_t elapsed = now_ns() - start;
+
+        if (r >= warmup)
+            ns_per_op[r - warmup] = (double) elapsed / ops;
+    }
+    qsort(ns_per_op, reps, sizeof(double), cmp_double);
+
+    double mean = 0;
+    for (uint32_t r = 0; r < reps; r++)
+        mean += ns_per_op[r];
+    mean /= reps;
+
+    double p50 = ns_per_op[reps / 2];
+    double p90 = ns_per_op[reps * 9 / 10];
+    double p99 = ns_per_op[reps * 99 / 100];
+
+    printf("%-22s %-50s %9.1f %9.1f %9.1f %9.1f %9.1f\n", bc->name, bb->name, \
+        ns_per_op[0], mean, p50, p90, p99);
+    if (csv) {
+        fprintf(csv, "%s,%s,%u,%u,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n", bc->name, bb->name, \
+            reps, ops, ns_per_op[0], mean, p50, p90, p99, ns_per_op[reps - 1]);
+    }
+
+    free(ns_per_op);
+}
+
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-r reps] [-n ops_per_rep] [-w warmup_reps] "
+        "[-d fixture_dir] [-o results.csv]\n", prog);
+}
+
+
+int main(int argc, char **argv) {
+    uint32_t reps = BENCH_DEFAULT_REPS;
+    uint32_t ops = BENCH_DEFAULT_OPS;
+    uint32_t warmup = BENCH_DEFAULT_WARMUP;
+    const char *fixture_dir = BENCH_DEFAULT_FIXTURE_DIR;
+    const char *csv_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:n:w:d:o:h")) != -1) {
+        switch (opt) {
+            case 'r':
+                reps = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                ops = strtoul(optarg, NULL, 10);
+                break;
+            case 'w':
+                warmup = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                fixture_dir = optarg;
+                break;
+            case 'o':
+                csv_path = optarg;
+                break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (reps == 0 || ops == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    static bench_board boards[BENCH_MAX_BOARDS];
+    int num_boards = 0;
+    bench_generated_board(&boards[num_boards++], "generated-empty", 0);
+    bench_generated_board(&boards[num_boards++], "generated-stack-8", 8);
+    bench_generated_board(&boards[num_boards++], "generated-stack-20", 20);
+    num_boards += bench_load_fixtures(&boards[num_boards], BENCH_MAX_BOARDS - num_boards, \
+        fixture_dir);
+
+    FILE *csv = NULL;
+    if (csv_path) {
+        csv = fopen(csv_path, "w");
+        if (csv == NULL) {
+            fprintf(stderr, "can't open %s for writing\n", csv_path);
+            return 1;
+        }
+        fprintf(csv, "benchmark,board,reps,ops_per_rep,min_ns,mean_ns,p50_ns,p90_ns,p99_ns,max_ns\n");
+    }
+
+    printf("reps=%u ops_per_rep=%u warmup=%u (ns/op)\n", reps, ops, warmup);
+    printf("%-22s %-50s %9s %9s %9s %9s %9s\n", "benchmark", "board", \
+        "min", "mean", "p50", "p90", "p99");
+    for (size_t c = 0; c < sizeof(bench_cases) / sizeof(bench_cases[0]); c++) {
+        for (int b = 0; b < num_boards; b++) {
+            bench_run(&bench_cases[c], &boards[b], reps, ops, warmup, csv);
+        }
+    }
+
+    if (csv)
+        fclose(csv);
+
+    return 0;
+}
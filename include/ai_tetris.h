@@ -0,0 +1,175 @@
+#ifndef AI_TETRIS
+#define AI_TETRIS
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <assert.h>
+
+#include "tetris.h"
+#include "tetris_placement.h"
+
+
+// defaults for the autoplayer
+#define AI_DEFAULT_BEAM_WIDTH 16
+// how many upcoming pieces (from tg_peek_ptypes) the search looks at
+#define AI_DEFAULT_LOOKAHEAD 1
+#define AI_DEFAULT_THREADS 1
+
+#define AI_MAX_BEAM_WIDTH 64
+#define AI_MAX_LOOKAHEAD 6
+#define AI_MAX_THREADS 64
+
+
+/**
+ * Board evaluation weights. A board scores the sum of each feature times
+ * its weight, so features that make the board worse get negative weights
+ * @param aggregate_height sum of column heights
+ * @param holes empty cells under the top of their column
+ * @param bumpiness sum of height differences between neighboring columns
+ * @param well_depth sum of how far columns sit below both neighbors
+ * @param max_height tallest column
+ * @param lines_cleared rows cleared by the placements along the way
+*/
+typedef struct ai_weights {
+    float aggregate_height;
+    float holes;
+    float bumpiness;
+    float well_depth;
+    float max_height;
+    float lines_cleared;
+} ai_weights;
+
+/**
+ * Autoplayer configuration
+ * @param weights board evaluation weights
+ * @param beam_width boards kept at each search depth
+ * @param lookahead upcoming pieces searched after the active one
+ * @param num_threads threads expanding the beam, including the caller's
+*/
+typedef struct ai_config {
+    ai_weights weights;
+    uint8_t beam_width;
+    uint8_t lookahead;
+    uint8_t num_threads;
+} ai_config;
+
+/**
+ * Board reached by a sequence of placements during the search
+ * @param board board after the placements
+ * @param line_score weighted lines cleared along the way
+ * @param score line_score plus the evaluation of `board`
+ * @param root index of the first placement in the root placement list
+*/
+typedef struct ai_node {
+    TetrisBoard board;
+    float line_score;
+    float score;
+    uint16_t root;
+} ai_node;
+
+typedef void (*ai_pool_fn)(void *ctx, uint32_t item, uint32_t worker);
+
+struct ai_pool;
+
+// argument handed to each pool thread, worker 0 is the calling thread
+typedef struct ai_pool_worker {
+    struct ai_pool *pool;
+    uint32_t id;
+} ai_pool_worker;
+
+/**
+ * Fixed pool of worker threads. ai_pool_run() hands out item indices to the
+ * workers and the calling thread until all are done
+ * @param num_workers threads in the pool, not counting the caller
+ * @param job_gen bumped for every job so sleeping workers know there's work
+ * @param workers_done workers finished with the current job
+*/
+typedef struct ai_pool {
+    pthread_t threads[AI_MAX_THREADS];
+    ai_pool_worker workers[AI_MAX_THREADS];
+    uint32_t num_workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cv;
+    pthread_cond_t done_cv;
+    uint32_t job_gen;
+    uint32_t workers_done;
+    bool shutdown;
+
+    ai_pool_fn fn;
+    void *ctx;
+    uint32_t num_items;
+    atomic_uint next_item;
+} ai_pool;
+
+/**
+ * Per-thread search scratch space
+ * @param pl placement list for expanding one node
+ * @param game game whose board placements are locked into
+*/
+typedef struct ai_scratch {
+    TetrisPlacementList pl;
+    TetrisGame game;
+} ai_scratch;
+
+/**
+ * Autoplayer state
+ * @param cfg configuration
+ * @param pool worker threads
+ * @param scratch one per thread
+ * @param root_start active piece the search starts from
+ * @param root_pl placements of the active piece, kept for its paths
+ * @param beam boards kept at the current depth
+ * @param children best `beam_width` children of every beam node
+ * @param num_children number of children found for every beam node
+ * @param next_ptypes pieces the lookahead depths place
+ * @param depth search depth being expanded, 0 for the active piece
+ * @param moves path to the chosen placement
+ * @param path_len length of moves
+ * @param path_idx next move to play
+ * @param expected where the active piece should be before the next move
+ * @param planned_board_gen board_gen the plan was made for
+ * @param has_plan false until a plan is made, and after the piece locks
+*/
+typedef struct ai_player {
+    ai_config cfg;
+    ai_pool pool;
+    ai_scratch *scratch;
+    TetrisPiece root_start;
+    TetrisPlacementList root_pl;
+
+    ai_node *beam;
+    uint32_t beam_size;
+    ai_node *children;
+    uint8_t *num_children;
+    enum piece_type next_ptypes[AI_MAX_LOOKAHEAD];
+    uint8_t depth;
+
+    enum player_move moves[TETRIS_PLACEMENT_STATES];
+    uint16_t path_len;
+    uint16_t path_idx;
+    TetrisPiece expected;
+    uint32_t planned_board_gen;
+    bool has_plan;
+} ai_player;
+
+
+ai_config ai_default_config(void);
+ai_player *ai_create(const ai_config *cfg);
+void ai_destroy(ai_player *ai);
+void ai_reset(ai_player *ai);
+float ai_evaluate_board(const ai_weights *w, const TetrisBoard *tb);
+bool ai_plan(ai_player *ai, const TetrisGame *tg);
+enum player_move ai_next_move(ai_player *ai, const TetrisGame *tg);
+
+void ai_pool_init(ai_pool *pool, uint32_t num_workers);
+void ai_pool_run(ai_pool *pool, ai_pool_fn fn, void *ctx, uint32_t num_items);
+void ai_pool_destroy(ai_pool *pool);
+
+
+#endif
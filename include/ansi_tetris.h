@@ -0,0 +1,80 @@
+/**
+ * Direct ANSI terminal backend for the tetris driver
+ * @author Jacob Bokor
+ * @date 03/2024
+*/
+
+#ifndef ANSI_TETRIS_H
+#define ANSI_TETRIS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <termios.h>
+
+#include "tetris.h"
+#include "tetris_frame.h"
+
+// worst case bytes for one cell: cursor move, color, and the cell itself
+#define ANSI_CELL_MAX_BYTES 32
+// a full redraw of the board, with room for the border, score panel, and
+//  a message
+#define ANSI_FRAME_BUF_SIZE (TETRIS_ROWS * TETRIS_COLS * ANSI_CELL_MAX_BYTES + 4096)
+
+// screen position of the board's top left border corner, 1-based like the
+//  escape sequences, and the score panel to its right
+#define ANSI_BOARD_ROW 3
+#define ANSI_BOARD_COL 3
+#define ANSI_SCORE_COL (ANSI_BOARD_COL + 2 * TETRIS_COLS + 3)
+
+// keys ansi_getch() decodes from escape sequences, outside the byte range
+enum ansi_key {ANSI_KEY_UP = 0x100, ANSI_KEY_DOWN, ANSI_KEY_LEFT, ANSI_KEY_RIGHT};
+
+/**
+ * A raw mode terminal the driver draws to with escape sequences instead of
+ * ncurses. Each frame is built in `buf` and sent with a single write(),
+ * changed cells only, with 256-color backgrounds so every piece gets its
+ * own color
+ * @param in_fd, out_fd terminal to read keys from and draw to
+ * @param saved terminal settings to put back on close
+ * @param sync wrap frames in synchronized update sequences (DEC mode 2026)
+ *  so terminals that support it never show a half drawn frame
+ * @param buf frame being built, len bytes used
+ * @param cells active_board as last drawn
+ * @param active_board_gen tg->active_board_gen when it was drawn
+ * @param board_valid false when the board has to be drawn in full
+ * @param score, level, lines_cleared_since_last_level as last shown
+ * @param score_valid false when the score panel has to be drawn in full
+ * @param keys bytes read from the terminal, not decoded yet
+*/
+typedef struct AnsiTerm {
+    int in_fd;
+    int out_fd;
+    struct termios saved;
+    bool sync;
+
+    char buf[ANSI_FRAME_BUF_SIZE];
+    uint32_t len;
+
+    int8_t cells[TETRIS_ROWS][TETRIS_COLS];
+    uint32_t active_board_gen;
+    bool board_valid;
+    uint32_t score;
+    uint32_t level;
+    uint8_t lines_cleared_since_last_level;
+    bool score_valid;
+
+    uint8_t keys[64];
+    uint8_t keys_len;
+    uint8_t keys_pos;
+} AnsiTerm;
+
+
+bool ansi_open(AnsiTerm *t, int in_fd, int out_fd, bool sync);
+void ansi_close(AnsiTerm *t);
+bool ansi_draw(AnsiTerm *t, const TetrisFrame *f);
+void ansi_message(AnsiTerm *t, int row, const char *text);
+void ansi_status(AnsiTerm *t, const char *text);
+int ansi_getch(AnsiTerm *t);
+int ansi_wait_key(AnsiTerm *t);
+
+#endif
@@ -31,16 +31,33 @@
 #define SCORE_WIN_ROWS 10
 #define SCORE_WIN_COLS 30
 
-#define SCREEN_REFRESH_INTERVAL_USEC 25000 // 50ms
-
-
 // ncursew macros to print out filled and empty cells
 #define ADD_BLOCK(w,x) waddch((w),' '|A_REVERSE|COLOR_PAIR(x));     \
                        waddch((w),' '|A_REVERSE|COLOR_PAIR(x))
 #define ADD_EMPTY(w) waddch((w), ' '); waddch((w), ' ')
 
-void display_board(WINDOW *w, TetrisBoard b);
-void update_score(WINDOW *w, TetrisGame *tg);
+/**
+ * What the game and score windows last showed, so a redraw only sends the
+ * cells and lines that changed instead of repainting the windows
+ * @param cells active_board as it was last drawn
+ * @param active_board_gen tg->active_board_gen when it was drawn
+ * @param board_valid false when the game window has to be drawn in full,
+ *  eg after a prompt was written over it
+ * @param score, level, lines_cleared_since_last_level as last shown
+ * @param score_valid false when the score window has to be drawn in full
+*/
+typedef struct DriverScreen {
+    int8_t cells[TETRIS_ROWS][TETRIS_COLS];
+    uint32_t active_board_gen;
+    bool board_valid;
+    uint32_t score;
+    uint32_t level;
+    uint8_t lines_cleared_since_last_level;
+    bool score_valid;
+} DriverScreen;
+
+bool display_board(WINDOW *w, const TetrisGame *tg, DriverScreen *scr);
+bool update_score(WINDOW *w, const TetrisGame *tg, DriverScreen *scr);
 
 // Debug functions
 void print_keypress(enum player_move move);
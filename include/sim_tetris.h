@@ -0,0 +1,99 @@
+#ifndef SIM_TETRIS
+#define SIM_TETRIS
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <time.h>   // clock_gettime for throughput timing
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <assert.h>
+
+#include "tetris.h"
+#include "tetris_pool.h"
+#include "tetris_replay.h"
+#include "ai_tetris.h"
+
+
+// defaults for the batch simulator, all overridable from the command line
+#define SIM_DEFAULT_GAMES 1000
+#define SIM_DEFAULT_THREADS 4
+#define SIM_DEFAULT_SEED 1
+// cap on ticks per game, so a game that never tops out still finishes
+#define SIM_DEFAULT_MAX_TICKS 1000000
+// game time per tick, same 10ms period the ncurses driver aims for
+#define SIM_DEFAULT_FRAME_USEC 10000
+
+#define SIM_MAX_THREADS 256
+#define SIM_MAX_LEVEL_BUCKETS 32
+
+
+/**
+ * Move policy driving the simulated games
+ * @param name name used to pick the policy on the command line
+ * @param create allocate per-worker policy state from the batch config, may be NULL
+ * @param new_game reset state before each game, seeded per game so results 
+ *  don't depend on which worker played it. may be NULL
+ * @param next_move pick the move to pass to tg_tick for this tick
+ * @param destroy free per-worker policy state, may be NULL
+*/
+struct sim_config;
+
+typedef struct sim_policy {
+    const char *name;
+    void *(*create)(const struct sim_config *cfg);
+    void (*new_game)(void *state, uint64_t seed);
+    enum player_move (*next_move)(TetrisGame *tg, void *state);
+    void (*destroy)(void *state);
+} sim_policy;
+
+/**
+ * Batch configuration, shared read-only by all workers
+*/
+typedef struct sim_config {
+    uint32_t num_games;
+    uint32_t num_threads;
+    uint64_t seed;
+    uint64_t max_ticks;
+    uint32_t frame_usec;
+    enum tetris_randomizer randomizer;
+    const sim_policy *policy;
+    uint32_t ai_threads;    // search threads per game for the ai policy
+} sim_config;
+
+/**
+ * Result of a single simulated game
+*/
+typedef struct sim_game_result {
+    uint32_t score;
+    uint32_t level;
+    uint64_t ticks;
+    bool topped_out;    // false if the game hit max_ticks instead
+    bool failed;        // no game slot was free, so the game wasn't played
+} sim_game_result;
+
+/**
+ * Per-thread worker state
+*/
+typedef struct sim_worker {
+    pthread_t thread;
+    uint32_t id;
+    const sim_config *cfg;
+    sim_game_result *results;
+    atomic_uint *next_game;
+    bool failed;        // the worker stopped before the batch was done
+} sim_worker;
+
+
+void *sim_worker_run(void *arg);
+sim_game_result sim_play_game(const sim_config *cfg, uint32_t game_idx, void *policy_state, \
+    TetrisGamePool *pool);
+void sim_print_report(FILE *out, const sim_config *cfg, const sim_game_result *results, \
+    double elapsed_sec);
+const sim_policy *sim_find_policy(const char *name);
+
+
+#endif
@@ -0,0 +1,453 @@
+/**
+ * Heuristic autoplayer for the tetris game library
+ * @file ai_tetris.c
+ * @brief Picks a placement for the active piece with a beam search over
+ *  find_placements(): every reachable placement of the active piece is
+ *  scored with a weighted board evaluation, the best `beam_width` boards
+ *  are expanded with each upcoming piece from tg_peek_ptypes(), and the
+ *  first placement on the way to the best final board is played. Beam
+ *  nodes at each depth are expanded in parallel on a small thread pool.
+ *  ai_next_move() then feeds the path to that placement into tg_tick()
+ *  one move per tick, finishing with a hard drop.
+ * @author Jacob Bokor
+ * @date 03/2024
+ */
+
+#include "ai_tetris.h"
+
+
+/////////////// THREAD POOL ////////////////
+
+/**
+ * Claim and run items of the current job until there are none left
+*/
+static void ai_pool_work(ai_pool *pool, uint32_t worker) {
+    unsigned int item;
+    while ((item = atomic_fetch_add(&pool->next_item, 1)) < pool->num_items) {
+        pool->fn(pool->ctx, item, worker);
+    }
+}
+
+static void *ai_pool_thread(void *arg) {
+    ai_pool_worker *w = arg;
+    ai_pool *pool = w->pool;
+    uint32_t seen_gen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->job_gen == seen_gen && !pool->shutdown)
+            pthread_cond_wait(&pool->work_cv, &pool->lock);
+        if (pool->shutdown)
+            break;
+        seen_gen = pool->job_gen;
+        pthread_mutex_unlock(&pool->lock);
+
+        ai_pool_work(pool, w->id);
+
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->workers_done == pool->num_workers)
+            pthread_cond_signal(&pool->done_cv);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/**
+ * Start `num_workers` threads, which sleep until ai_pool_run() has work
+*/
+void ai_pool_init(ai_pool *pool, uint32_t num_workers) {
+    assert(num_workers < AI_MAX_THREADS);
+    pool->num_workers = num_workers;
+    pool->job_gen = 0;
+    pool->workers_done = 0;
+    pool->shutdown = false;
+    pool->num_items = 0;
+    atomic_init(&pool->next_item, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cv, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+
+    for (uint32_t i = 0; i < num_workers; i++) {
+        // worker 0 is the thread calling ai_pool_run()
+        pool->workers[i] = (ai_pool_worker) {.pool = pool, .id = i + 1};
+        pthread_create(&pool->threads[i], NULL, ai_pool_thread, &pool->workers[i]);
+    }
+}
+
+/**
+ * Run fn(ctx, item, worker) for every item in [0, num_items) across the
+ * pool and the calling thread, returning once all of them are done
+*/
+void ai_pool_run(ai_pool *pool, ai_pool_fn fn, void *ctx, uint32_t num_items) {
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->num_items = num_items;
+    atomic_store(&pool->next_item, 0);
+    pool->workers_done = 0;
+    pool->job_gen++;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+
+    ai_pool_work(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->workers_done < pool->num_workers)
+        pthread_cond_wait(&pool->done_cv, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void ai_pool_destroy(ai_pool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work_cv);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (uint32_t i = 0; i < pool->num_workers; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cv);
+    pthread_cond_destroy(&pool->done_cv);
+}
+
+
+/////////////// EVALUATION ////////////////
+
+/**
+ * Default configuration. Height/holes/bumpiness/lines weights are the ones
+ * commonly used for this feature set, the well and max height terms were
+ * tuned against tetris_sim
+*/
+ai_config ai_default_config(void) {
+    ai_config cfg = {
+        .weights = {
+            .aggregate_height = -0.510066f,
+            .holes = -0.35663f,
+            .bumpiness = -0.184483f,
+            .well_depth = -0.05f,
+            .max_height = -0.1f,
+            .lines_cleared = 0.760666f,
+        },
+        .beam_width = AI_DEFAULT_BEAM_WIDTH,
+        .lookahead = AI_DEFAULT_LOOKAHEAD,
+        .num_threads = AI_DEFAULT_THREADS,
+    };
+    return cfg;
+}
+
+/**
+ * Score a board from its column metrics, higher is better. Lines cleared
+ * are scored separately, as the search places pieces
+*/
+float ai_evaluate_board(const ai_weights *w, const TetrisBoard *tb) {
+    uint16_t aggregate_height = 0;
+    uint8_t max_height = 0;
+    for (int col = 0; col < TETRIS_COLS; col++) {
+        aggregate_height += tb->col_height[col];
+        if (tb->col_height[col] > max_height)
+            max_height = tb->col_height[col];
+    }
+
+    return w->aggregate_height * aggregate_height + w->holes * tb->holes + \
+        w->bumpiness * tb->bumpiness + w->well_depth * tb->well_depth + \
+        w->max_height * max_height;
+}
+
+
+/////////////// SEARCH ////////////////
+
+/**
+ * Expand beam node `item` at the current depth: place the depth's piece
+ * everywhere it can go and keep the node's best `beam_width` children,
+ * sorted best first. Runs on a pool thread, and only writes to the node's
+ * own children and the worker's own scratch space
+*/
+static void ai_expand_node(void *ctx, uint32_t item, uint32_t worker) {
+    ai_player *ai = ctx;
+    ai_scratch *scratch = &ai->scratch[worker];
+    const ai_node *node = &ai->beam[item];
+    ai_node *children = &ai->children[item * ai->cfg.beam_width];
+
+    // the active piece is searched from where it is, upcoming pieces from spawn
+    TetrisPlacementList *pl;
+    if (ai->depth == 0) {
+        pl = &ai->root_pl;
+        find_placements_from(&node->board, ai->root_start, pl);
+    }
+    else {
+        pl = &scratch->pl;
+        find_placements(&node->board, ai->next_ptypes[ai->depth - 1], pl);
+    }
+
+    // rank placements by score first and only build boards for the kept
+    //  ones, locking a piece is much cheaper than shuffling boards around
+    struct {float score; float line_score; uint16_t idx;} best[AI_MAX_BEAM_WIDTH];
+    uint8_t num_best = 0;
+    for (uint16_t i = 0; i < pl->num_placements; i++) {
+        scratch->game.board = node->board;
+        uint8_t lines = lock_piece(&scratch->game, placement_to_piece(pl, i));
+
+        float line_score = node->line_score + ai->cfg.weights.lines_cleared * lines;
+        float score = line_score + ai_evaluate_board(&ai->cfg.weights, &scratch->game.board);
+
+        // insert into the sorted list, dropping the worst if it's full
+        int pos = num_best;
+        if (pos == ai->cfg.beam_width) {
+            if (score <= best[pos - 1].score)
+                continue;
+            pos--;
+        }
+        else {
+            num_best++;
+        }
+        while (pos > 0 && best[pos - 1].score < score) {
+            best[pos] = best[pos - 1];
+            pos--;
+        }
+        best[pos].score = score;
+        best[pos].line_score = line_score;
+        best[pos].idx = i;
+    }
+
+    for (uint8_t c = 0; c < num_best; c++) {
+        scratch->game.board = node->board;
+        lock_piece(&scratch->game, placement_to_piece(pl, best[c].idx));
+        children[c].board = scratch->game.board;
+        children[c].line_score = best[c].line_score;
+        children[c].score = best[c].score;
+        children[c].root = (ai->depth == 0) ? best[c].idx : node->root;
+    }
+    ai->num_children[item] = num_best;
+}
+
+/**
+ * Gather the best `beam_width` children of all beam nodes into the beam. 
+ * Different placement orders often build the same stack, so children are 
+ * deduplicated by board hash to keep the beam from filling with copies
+ * @returns new beam size, 0 if no node had any children
+*/
+static uint32_t ai_select_beam(ai_player *ai) {
+    const uint8_t width = ai->cfg.beam_width;
+    uint8_t taken[AI_MAX_BEAM_WIDTH] = {0};
+    uint32_t size = 0;
+
+    // every node's children are already sorted, so this is a k-way merge
+    while (size < width) {
+        int best = -1;
+        for (uint32_t n = 0; n < ai->beam_size; n++) {
+            if (taken[n] == ai->num_children[n])
+                continue;
+            if (best < 0 || ai->children[n * width + taken[n]].score > \
+                ai->children[best * width + taken[best]].score)
+                best = n;
+        }
+        if (best < 0)
+            break;
+
+        const ai_node *child = &ai->children[best * width + taken[best]];
+        taken[best]++;
+        bool seen = false;
+        for (uint32_t i = 0; i < size && !seen; i++)
+            seen = ai->beam[i].board.hash == child->board.hash;
+        if (!seen)
+            ai->beam[size++] = *child;
+    }
+    return size;
+}
+
+/**
+ * Pick a placement for the active piece of `tg` and build the moves to get
+ * there. Doesn't change the game
+ * @returns false if the active piece has nowhere to go
+*/
+bool ai_plan(ai_player *ai, const TetrisGame *tg) {
+    ai->has_plan = false;
+    ai->root_start = tg->active_piece;
+    tg_peek_ptypes(tg, ai->next_ptypes, ai->cfg.lookahead);
+
+    ai->beam[0].board = tg->board;
+    ai->beam[0].line_score = 0;
+    ai->beam[0].score = 0;
+    ai->beam[0].root = 0;
+    ai->beam_size = 1;
+
+    int best_root = -1;
+    for (ai->depth = 0; ai->depth <= ai->cfg.lookahead; ai->depth++) {
+        ai_pool_run(&ai->pool, ai_expand_node, ai, ai->beam_size);
+        uint32_t size = ai_select_beam(ai);
+        if (size == 0)
+            break;      // every line tops out here, go with the previous depth's best
+        ai->beam_size = size;
+        best_root = ai->beam[0].root;
+    }
+    if (best_root < 0)
+        return false;
+
+    ai->path_len = get_placement_path(&ai->root_pl, best_root, ai->moves, TETRIS_PLACEMENT_STATES);
+    ai->path_idx = 0;
+    ai->expected = tg->active_piece;
+    ai->planned_board_gen = tg->board_gen;
+    ai->has_plan = true;
+    return true;
+}
+
+
+/////////////// PLAYING ////////////////
+
+static inline bool same_position(const TetrisPiece a, const TetrisPiece b) {
+    return a.ptype == b.ptype && a.orientation == b.orientation && \
+        a.loc.row == b.loc.row && a.loc.col == b.loc.col;
+}
+
+/**
+ * Apply `move` to `tp` the way tg_tick() would, if it fits on the board
+ * @returns false if the move is blocked
+*/
+static bool ai_try_move(const TetrisBoard *tb, TetrisPiece *tp, enum player_move move) {
+    TetrisPiece next = *tp;
+    switch (move) {
+        case T_UP:
+            next.orientation = (next.orientation + 1) % NUM_ORIENTATIONS;
+            break;
+        case T_DOWN:
+            next.loc.row++;
+            break;
+        case T_LEFT:
+            next.loc.col--;
+            break;
+        case T_RIGHT:
+            next.loc.col++;
+            break;
+        default:
+            break;
+    }
+    if (!test_piece_position(tb, next))
+        return false;
+    *tp = next;
+    return true;
+}
+
+/**
+ * Gravity pulled the active piece below where the plan expected it. Drop
+ * T_DOWN moves gravity already did from the rest of the path and check the
+ * shortened path still fits from where the piece is now, which saves a
+ * replan every time gravity fires at high levels
+ * @returns false if the plan has to be redone
+*/
+static bool ai_resume_plan(ai_player *ai, const TetrisGame *tg) {
+    const TetrisPiece tp = tg->active_piece;
+    if (tp.ptype != ai->expected.ptype || tp.orientation != ai->expected.orientation || \
+        tp.loc.col != ai->expected.loc.col || tp.loc.row < ai->expected.loc.row)
+        return false;
+
+    int excess = tp.loc.row - ai->expected.loc.row;
+    enum player_move rest[TETRIS_PLACEMENT_STATES];
+    uint16_t rest_len = 0;
+    for (uint16_t i = ai->path_idx; i < ai->path_len; i++) {
+        if (ai->moves[i] == T_DOWN && excess > 0)
+            excess--;
+        else
+            rest[rest_len++] = ai->moves[i];
+    }
+    if (excess > 0)
+        return false;       // fell past the planned placement
+
+    TetrisPiece sim = tp;
+    for (uint16_t i = 0; i < rest_len; i++) {
+        if (!ai_try_move(&tg->board, &sim, rest[i]))
+            return false;
+    }
+
+    memcpy(ai->moves, rest, rest_len * sizeof(enum player_move));
+    ai->path_idx = 0;
+    ai->path_len = rest_len;
+    ai->expected = tp;
+    return true;
+}
+
+/**
+ * Move to pass to tg_tick() this tick. Plans when a new piece shows up,
+ * follows the plan one move per tick, and hard drops once only T_DOWN
+ * moves are left. If the piece isn't where the plan expects and the plan
+ * can't be resumed from there, it replans from where the piece actually is
+*/
+enum player_move ai_next_move(ai_player *ai, const TetrisGame *tg) {
+    bool on_plan = ai->has_plan && tg->board_gen == ai->planned_board_gen;
+    if (on_plan && !same_position(tg->active_piece, ai->expected))
+        on_plan = ai_resume_plan(ai, tg);
+
+    if (!on_plan) {
+        if (!ai_plan(ai, tg))
+            return T_HARDDROP;
+    }
+
+    bool only_drops_left = true;
+    for (uint16_t i = ai->path_idx; i < ai->path_len; i++) {
+        if (ai->moves[i] != T_DOWN) {
+            only_drops_left = false;
+            break;
+        }
+    }
+    if (only_drops_left) {
+        // piece locks this tick, the next one gets a new plan
+        ai->has_plan = false;
+        return T_HARDDROP;
+    }
+
+    enum player_move move = ai->moves[ai->path_idx++];
+    ai_try_move(&tg->board, &ai->expected, move);
+    return move;
+}
+
+
+/////////////// SETUP ////////////////
+
+ai_player *ai_create(const ai_config *cfg) {
+    assert(cfg->beam_width > 0 && cfg->beam_width <= AI_MAX_BEAM_WIDTH);
+    assert(cfg->lookahead <= AI_MAX_LOOKAHEAD);
+    assert(cfg->num_threads > 0 && cfg->num_threads <= AI_MAX_THREADS);
+
+    ai_player *ai = malloc(sizeof(ai_player));
+    if (ai == NULL)
+        return NULL;
+
+    ai->cfg = *cfg;
+    ai->scratch = calloc(cfg->num_threads, sizeof(ai_scratch));
+    ai->beam = malloc(cfg->beam_width * sizeof(ai_node));
+    ai->children = malloc(cfg->beam_width * cfg->beam_width * sizeof(ai_node));
+    ai->num_children = malloc(cfg->beam_width);
+    if (ai->scratch == NULL || ai->beam == NULL || ai->children == NULL || ai->num_children == NULL) {
+        free(ai->scratch);
+        free(ai->beam);
+        free(ai->children);
+        free(ai->num_children);
+        free(ai);
+        return NULL;
+    }
+
+    ai_pool_init(&ai->pool, cfg->num_threads - 1);
+    ai_reset(ai);
+    return ai;
+}
+
+/**
+ * Forget the current plan, eg when starting a new game
+*/
+void ai_reset(ai_player *ai) {
+    ai->has_plan = false;
+    ai->path_len = 0;
+    ai->path_idx = 0;
+}
+
+void ai_destroy(ai_player *ai) {
+    if (ai == NULL)
+        return;
+    ai_pool_destroy(&ai->pool);
+    free(ai->scratch);
+    free(ai->beam);
+    free(ai->children);
+    free(ai->num_children);
+    free(ai);
+}
@@ -0,0 +1,279 @@
+/**
+ * Direct ANSI terminal backend for the tetris driver
+ * @file ansi_tetris.c
+ * @brief Draws the game with escape sequences written straight to the
+ *  terminal, for terminals and raw ptys where ncurses' per-character
+ *  overhead and 8 colors get in the way. A frame is the cells that changed
+ *  since the last one plus the score panel if it changed, built in one
+ *  preallocated buffer and sent with a single write(), optionally inside a
+ *  synchronized update so it never tears.
+ * @author Jacob Bokor
+ * @date 03/2024
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include "ansi_tetris.h"
+
+
+// 256-color palette index for each piece_type
+static const uint8_t piece_colors_256[NUM_TETROMINOS] = {
+    46,     // S, green
+    196,    // Z, red
+    129,    // T, purple
+    208,    // L, orange
+    21,     // J, blue
+    226,    // SQ, yellow
+    51,     // I, cyan
+};
+
+
+static void ansi_put(AnsiTerm *t, const char *s, uint32_t n) {
+    assert(t->len + n <= ANSI_FRAME_BUF_SIZE && "ANSI frame buffer overflow");
+    memcpy(t->buf + t->len, s, n);
+    t->len += n;
+}
+
+#define ANSI_PUT_LITERAL(t, s) ansi_put((t), (s), sizeof(s) - 1)
+
+static void ansi_printf(AnsiTerm *t, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void ansi_printf(AnsiTerm *t, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(t->buf + t->len, ANSI_FRAME_BUF_SIZE - t->len, fmt, args);
+    va_end(args);
+    assert(n >= 0 && t->len + n < ANSI_FRAME_BUF_SIZE && "ANSI frame buffer overflow");
+    t->len += n;
+}
+
+static void ansi_move(AnsiTerm *t, int row, int col) {
+    ansi_printf(t, "\x1b[%d;%dH", row, col);
+}
+
+/**
+ * Send the frame built so far in one write() and start a new one
+*/
+static void ansi_flush(AnsiTerm *t) {
+    uint32_t off = 0;
+    while (off < t->len) {
+        ssize_t n = write(t->out_fd, t->buf + off, t->len - off);
+        if (n <= 0)
+            break;
+        off += n;
+    }
+    t->len = 0;
+}
+
+static void ansi_begin_frame(AnsiTerm *t) {
+    t->len = 0;
+    if (t->sync)
+        ANSI_PUT_LITERAL(t, "\x1b[?2026h");
+}
+
+static void ansi_end_frame(AnsiTerm *t) {
+    ANSI_PUT_LITERAL(t, "\x1b[0m");
+    if (t->sync)
+        ANSI_PUT_LITERAL(t, "\x1b[?2026l");
+    ansi_flush(t);
+}
+
+static void ansi_draw_border(AnsiTerm *t) {
+    const int width = 2 * TETRIS_COLS;
+    ansi_move(t, ANSI_BOARD_ROW, ANSI_BOARD_COL);
+    ANSI_PUT_LITERAL(t, "+");
+    for (int i = 0; i < width; i++)
+        ANSI_PUT_LITERAL(t, "-");
+    ANSI_PUT_LITERAL(t, "+");
+    for (int row = 1; row <= TETRIS_ROWS; row++) {
+        ansi_move(t, ANSI_BOARD_ROW + row, ANSI_BOARD_COL);
+        ANSI_PUT_LITERAL(t, "|");
+        ansi_move(t, ANSI_BOARD_ROW + row, ANSI_BOARD_COL + width + 1);
+        ANSI_PUT_LITERAL(t, "|");
+    }
+    ansi_move(t, ANSI_BOARD_ROW + TETRIS_ROWS + 1, ANSI_BOARD_COL);
+    ANSI_PUT_LITERAL(t, "+");
+    for (int i = 0; i < width; i++)
+        ANSI_PUT_LITERAL(t, "-");
+    ANSI_PUT_LITERAL(t, "+");
+}
+
+/**
+ * Put the terminal in raw mode on the alternate screen, with the cursor
+ * hidden
+ * @returns false if `in_fd` isn't a terminal
+*/
+bool ansi_open(AnsiTerm *t, int in_fd, int out_fd, bool sync) {
+    memset(t, 0, sizeof(AnsiTerm));
+    t->in_fd = in_fd;
+    t->out_fd = out_fd;
+    t->sync = sync;
+    if (tcgetattr(in_fd, &t->saved) != 0)
+        return false;
+
+    struct termios raw = t->saved;
+    raw.c_iflag &= ~(IXON | ICRNL | BRKINT | INPCK | ISTRIP);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN);     // keep ISIG so ^C still works
+    raw.c_cc[VMIN] = 0;     // reads return whatever is waiting, without blocking
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(in_fd, TCSAFLUSH, &raw) != 0)
+        return false;
+
+    // alternate screen, hide cursor, clear
+    ANSI_PUT_LITERAL(t, "\x1b[?1049h\x1b[?25l\x1b[2J");
+    ansi_flush(t);
+    return true;
+}
+
+/**
+ * Leave the alternate screen and put the terminal back how it was
+*/
+void ansi_close(AnsiTerm *t) {
+    t->len = 0;
+    ANSI_PUT_LITERAL(t, "\x1b[0m\x1b[?25h\x1b[?1049l");
+    ansi_flush(t);
+    tcsetattr(t->in_fd, TCSAFLUSH, &t->saved);
+}
+
+/**
+ * Draw frame `f`: the board cells that changed since the last frame and the
+ * score panel if it changed, in one write()
+ * @returns false if nothing changed and nothing was written
+*/
+bool ansi_draw(AnsiTerm *t, const TetrisFrame *f) {
+    bool board_changed = !t->board_valid || t->active_board_gen != f->active_board_gen;
+    bool score_changed = !t->score_valid || t->score != f->score || t->level != f->level || \
+        t->lines_cleared_since_last_level != f->lines_cleared_since_last_level;
+    if (!board_changed && !score_changed)
+        return false;
+
+    ansi_begin_frame(t);
+    if (board_changed) {
+        if (!t->board_valid)
+            ansi_draw_border(t);
+
+        // the cursor and color carry over between cells, so a run of
+        //  changed cells of one color costs two spaces each
+        int cursor_row = -1, cursor_col = -1;
+        int8_t color = BG_COLOR - 1;
+        for (int row = 0; row < TETRIS_ROWS; row++) {
+            for (int col = 0; col < TETRIS_COLS; col++) {
+                int8_t cell = f->cells[row][col];
+                if (t->board_valid && t->cells[row][col] == cell)
+                    continue;
+
+                if (row != cursor_row || col != cursor_col)
+                    ansi_move(t, ANSI_BOARD_ROW + 1 + row, ANSI_BOARD_COL + 1 + 2 * col);
+                if (cell != color) {
+                    if (cell >= 0 && cell < NUM_TETROMINOS)
+                        ansi_printf(t, "\x1b[48;5;%um", piece_colors_256[cell]);
+                    else
+                        ANSI_PUT_LITERAL(t, "\x1b[49m");
+                    color = cell;
+                }
+                ANSI_PUT_LITERAL(t, "  ");
+                cursor_row = row;
+                cursor_col = col + 1;
+                t->cells[row][col] = cell;
+            }
+        }
+        ANSI_PUT_LITERAL(t, "\x1b[49m");
+        t->active_board_gen = f->active_board_gen;
+        t->board_valid = true;
+    }
+
+    if (score_changed) {
+        // pad the numbers so a shorter value covers up the longer one before it
+        ansi_move(t, ANSI_BOARD_ROW + 1, ANSI_SCORE_COL);
+        ansi_printf(t, "Score: %-10u", f->score);
+        ansi_move(t, ANSI_BOARD_ROW + 2, ANSI_SCORE_COL);
+        ansi_printf(t, "Level: %-10u", f->level);
+        ansi_move(t, ANSI_BOARD_ROW + 3, ANSI_SCORE_COL);
+        ansi_printf(t, "Lines until next Level: %-3d", 10 - f->lines_cleared_since_last_level);
+        t->score = f->score;
+        t->level = f->level;
+        t->lines_cleared_since_last_level = f->lines_cleared_since_last_level;
+        t->score_valid = true;
+    }
+    ansi_end_frame(t);
+    return true;
+}
+
+/**
+ * Write `text` centered over board row `row`, eg for a prompt. The next
+ * ansi_draw() redraws the board under it
+*/
+void ansi_message(AnsiTerm *t, int row, const char *text) {
+    int len = strlen(text);
+    ansi_begin_frame(t);
+    ansi_move(t, ANSI_BOARD_ROW + 1 + row, ANSI_BOARD_COL + 1 + (2 * TETRIS_COLS - len) / 2);
+    ansi_printf(t, "\x1b[7m%s", text);
+    ansi_end_frame(t);
+    t->board_valid = false;
+}
+
+/**
+ * Write `text` under the score panel in place of whatever status was there. 
+ * It stays until the next call, so ansi_status(t, "") clears it
+*/
+void ansi_status(AnsiTerm *t, const char *text) {
+    ansi_begin_frame(t);
+    ansi_move(t, ANSI_BOARD_ROW + 4, ANSI_SCORE_COL);
+    ansi_printf(t, "%s\x1b[K", text);      // erase the rest of an older, longer one
+    ansi_end_frame(t);
+}
+
+/**
+ * Next key waiting on the terminal, with arrow key sequences (CSI or SS3)
+ * decoded to ansi_key values. Doesn't block
+ * @returns the key, or -1 if none is waiting
+*/
+int ansi_getch(AnsiTerm *t) {
+    if (t->keys_pos >= t->keys_len) {
+        ssize_t n = read(t->in_fd, t->keys, sizeof(t->keys));
+        t->keys_len = n > 0 ? n : 0;
+        t->keys_pos = 0;
+        if (t->keys_len == 0)
+            return -1;
+    }
+
+    uint8_t c = t->keys[t->keys_pos++];
+    if (c != 0x1b || t->keys_len - t->keys_pos < 2)
+        return c;
+    uint8_t intro = t->keys[t->keys_pos];
+    if (intro != '[' && intro != 'O')
+        return c;
+
+    switch (t->keys[t->keys_pos + 1]) {
+        case 'A':
+            t->keys_pos += 2;
+            return ANSI_KEY_UP;
+        case 'B':
+            t->keys_pos += 2;
+            return ANSI_KEY_DOWN;
+        case 'C':
+            t->keys_pos += 2;
+            return ANSI_KEY_RIGHT;
+        case 'D':
+            t->keys_pos += 2;
+            return ANSI_KEY_LEFT;
+        default:
+            return c;
+    }
+}
+
+/**
+ * Block until a key comes in, for prompts
+*/
+int ansi_wait_key(AnsiTerm *t) {
+    int ch;
+    while ((ch = ansi_getch(t)) < 0) {
+        struct pollfd pfd = {.fd = t->in_fd, .events = POLLIN};
+        if (poll(&pfd, 1, -1) < 0 || (pfd.revents & (POLLHUP | POLLERR)))
+            return -1;
+    }
+    return ch;
+}
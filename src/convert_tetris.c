@@ -0,0 +1,113 @@
+/**
+ * Converts saved games between the INI format from save_game_state() and 
+ * binary snapshots from tetris_snapshot.h
+ * @file convert_tetris.c
+ * @brief The direction is picked from the input: a file starting with the 
+ *  snapshot magic is written out as INI, anything else is parsed as INI 
+ *  and written as a snapshot. With -c, every input INI is appended to one 
+ *  corpus file of back to back snapshots.
+ * @author Jacob Bokor
+ * @date 03/2024
+ *
+ * Usage: tetris_convert in.ini out.tgs
+ *        tetris_convert in.tgs out.ini
+ *        tetris_convert -c corpus.tgs in1.ini [in2.ini ...]
+ */
+
+#include <unistd.h>     // getopt
+
+#include "utils.h"
+#include "tetris.h"
+#include "tetris_snapshot.h"
+
+
+static bool is_snapshot_file(const char *filename) {
+    char magic[4];
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL)
+        return false;
+    bool is_snap = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && \
+        memcmp(magic, TG_SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+    fclose(f);
+    return is_snap;
+}
+
+/**
+ * Parse INI save `filename` into a snapshot
+*/
+static bool ini_to_snapshot(const char *filename, TetrisSnapshot *snap) {
+    TetrisGame *tg = create_game_seeded(0);
+    bool ok = restore_game_state(tg, filename, stderr);
+    if (ok)
+        tg_snapshot_save(tg, snap);
+    end_game(tg);
+    return ok;
+}
+
+static int convert_to_ini(const char *in, const char *out) {
+    TetrisGame *tg = create_game_seeded(0);
+    bool ok = tg_snapshot_read_file(tg, in);
+    if (ok)
+        save_game_state(tg, out);
+    else
+        fprintf(stderr, "'%s' isn't a valid snapshot for a %dx%d board\n", in, TETRIS_ROWS, TETRIS_COLS);
+    end_game(tg);
+    return ok ? 0 : 1;
+}
+
+/**
+ * Write every INI in `ins` as snapshots, back to back, to `out`
+*/
+static int convert_to_snapshots(const char *out, char **ins, int num_ins) {
+    FILE *f = fopen(out, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "can't open '%s' for writing\n", out);
+        return 1;
+    }
+
+    int ret = 0;
+    TetrisSnapshot snap;
+    for (int i = 0; i < num_ins && ret == 0; i++) {
+        if (!ini_to_snapshot(ins[i], &snap) || fwrite(&snap, sizeof(snap), 1, f) != 1) {
+            fprintf(stderr, "failed to convert '%s'\n", ins[i]);
+            ret = 1;
+        }
+    }
+    if (fclose(f) != 0)
+        ret = 1;
+    return ret;
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s in.ini out.tgs\n", prog);
+    fprintf(stderr, "       %s in.tgs out.ini\n", prog);
+    fprintf(stderr, "       %s -c corpus.tgs in1.ini [in2.ini ...]\n", prog);
+}
+
+
+int main(int argc, char **argv) {
+    const char *corpus = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:h")) != -1) {
+        switch (opt) {
+            case 'c':
+                corpus = optarg;
+                break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    int num_args = argc - optind;
+    if (corpus != NULL && num_args > 0)
+        return convert_to_snapshots(corpus, &argv[optind], num_args);
+    if (corpus != NULL || num_args != 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (is_snapshot_file(argv[optind]))
+        return convert_to_ini(argv[optind], argv[optind + 1]);
+    return convert_to_snapshots(argv[optind + 1], &argv[optind], 1);
+}
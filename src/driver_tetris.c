@@ -7,11 +7,26 @@
  * @author Jacob Bokor
  * @date 03/2024
  *
+ * Usage: tetris_driver [-r replay_file] [-a [-s] [-t]]
+ *  -r records the game to replay_file, see tetris_replay.h
+ *  -a draws with escape sequences instead of ncurses, see ansi_tetris.h
+ *  -s with -a, wraps frames in synchronized updates
+ *  -t with -a, draws on a separate render thread, see render_main()
  */
 
 #include "driver_tetris.h"
 #include "utils.h"
 #include "tetris.h"
+#include "tetris_replay.h"
+#include "tetris_input.h"
+#include "ansi_tetris.h"
+#include "tetris_frame.h"
+#include <unistd.h>     // getopt
+#include <errno.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
 
 // show extra window with debugging information
 // #define DEBUG_T_WIN 1
@@ -22,49 +37,376 @@ WINDOW *dbg_win;
 // needs to be here for debug_win
 TetrisGame *tg;
 
-int main(void) {
+// replays run on a 10ms frame clock, see the main loop
+#define DRIVER_FRAME_USEC 10000
 
+// direct ANSI backend, NULL when drawing with ncurses
+static AnsiTerm *ansi_term = NULL;
 
-    // set up ncurses
-    WINDOW *g_win, *s_win;      // game and score windows
-    initscr();
-    cbreak();
-    noecho();       // dont echo key presses to screen
-    keypad(stdscr, TRUE);    // enable use of arrow and function keys
-    curs_set(0);   // don't show cursor on screen 
-    timeout(0);         // dont block on getch()
-    nodelay(stdscr, TRUE);
-    // getmaxyx(stdscr, row, col);      // get window size to int row, int col
-    
-    // refresh();
+// the render thread draws at most one frame per this long
+#define DRIVER_RENDER_USEC 16667
 
-    const int winheight = TETRIS_ROWS;
-    const int winwidth = BLOCK_WIDTH * TETRIS_COLS;
-    // ncurses window def: WINDOW *newwin(int nlines, int ncols, int begin_y, int begin_x);
-    g_win = newwin(winheight + 2, winwidth + 2, 2, 2);        // creates game window
+// how long a status line like "GAME STATE SAVED" stays up
+#define DRIVER_STATUS_USEC 2000000
 
-    nc_init_colors();
-    s_win = newwin(SCORE_WIN_ROWS, SCORE_WIN_COLS, 2, winwidth + 5); // score window
-    box(g_win, 0,0);
-    box(s_win, 0,0);
+/**
+ * Render thread state for -t. The game thread publishes a frame after 
+ * every pass through its loop and pokes `efd`; the render thread draws the
+ * newest one, so terminal output never holds up a tick
+ * @param frames triple buffer from the game thread to the render thread
+ * @param term_lock serializes writes to the terminal between the render 
+ *  thread's frames and the game thread's prompts
+ * @param prompting true while the game thread has a prompt up, so frames
+ *  are dropped instead of drawn over it. Guarded by term_lock
+ * @param efd eventfd the game thread signals after publishing
+ * @param stop set by the game thread to have the renderer draw the last 
+ *  frame and exit
+*/
+typedef struct DriverRender {
+    TetrisFrameBuffer frames;
+    pthread_t thread;
+    pthread_mutex_t term_lock;
+    bool prompting;
+    int efd;
+    _Atomic bool stop;
+} DriverRender;
+
+// NULL when the game thread draws
+static DriverRender *render = NULL;
+
+
+static uint64_t monotonic_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-    wrefresh(g_win);
-    wrefresh(s_win);
+/**
+ * Monotonic time the next tick is due at, for the game to move without
+ * input. Live games run on the monotonic clock, so that's just their next
+ * gravity deadline. Replays run on the frame clock, where the tick that
+ * brings game time to `virtual_usec` is due at `frame_origin_usec` plus the 
+ * game time before it; gravity fires on the first tick at or past the 
+ * deadline, so wait for that tick
+*/
+static uint64_t next_tick_deadline_usec(const TetrisGame *tg, uint64_t frame_origin_usec) {
+    uint64_t gravity_usec = tg->last_gravity_tick_usec + tg->gravity_tick_rate_usec;
+    if (tg->clock.source != TG_CLOCK_FRAME)
+        return gravity_usec;
+
+    uint64_t now = tg->clock.virtual_usec;
+    uint32_t frame = tg->clock.frame_usec;
+    uint64_t frames = gravity_usec > now ? (gravity_usec - now + frame - 1) / frame : 1;
+    return frame_origin_usec + now + (frames - 1) * frame;
+}
 
-    // CREATE DEBUG WINDOW
-    #ifdef DEBUG_T_WIN
-    dbg_win = newwin(winheight + 2 - SCORE_WIN_ROWS,  SCORE_WIN_COLS, \
-     2 + SCORE_WIN_ROWS, winwidth + 5); // score window
-    box(dbg_win, 0, 0);
-    wrefresh(dbg_win);
+/**
+ * Arm `tfd` to expire once at monotonic time `usec`. A time already past
+ * expires right away
+*/
+static void arm_tick_timer(int tfd, uint64_t usec) {
+    // an all-zero it_value would disarm the timer instead
+    if (usec == 0)
+        usec = 1;
+    struct itimerspec its = {
+        .it_value = {.tv_sec = usec / 1000000, .tv_nsec = (usec % 1000000) * 1000},
+    };
+    timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
 
-    #endif
+/**
+ * Run a tick with every move queued in `input`. When recording to `replay`,
+ * which takes one move per tick, each move instead gets a tick on the frame
+ * it came in, with T_NONE ticks for the frames that went by without one
+*/
+static void driver_tick(TetrisReplay *replay, TetrisGame *tg, TetrisInputQueue *input, \
+    uint64_t frame_origin_usec) {
+    // this function handles basically everything about the internal game state. 
+    // all the driver really has to do is pass `move` along to it and then print out
+    //  the tg->active_board array in whatever format is desired
+    if (replay == NULL) {
+        enum player_move moves[TG_INPUT_CAPACITY];
+        uint32_t n = tg_input_drain(input, moves, TG_INPUT_CAPACITY, UINT64_MAX);
+        tg_tick_moves(tg, moves, n);
+        return;
+    }
+
+    // more moves than frames gone by run ahead on the following frames
+    uint64_t now = monotonic_usec();
+    do {
+        uint64_t frame_end_usec = frame_origin_usec + tg->clock.virtual_usec + tg->clock.frame_usec;
+        enum player_move move = T_NONE;
+        tg_input_drain(input, &move, 1, frame_end_usec - 1);
+        replay_tick(replay, tg, move);
+    } while (!tg->game_over && (frame_origin_usec + tg->clock.virtual_usec <= now || \
+        tg_input_pending(input) > 0));
+}
+
+static void term_lock(void) {
+    if (render)
+        pthread_mutex_lock(&render->term_lock);
+}
+
+static void term_unlock(void) {
+    if (render)
+        pthread_mutex_unlock(&render->term_lock);
+}
+
+/**
+ * Render thread for -t: sleeps until the game thread publishes a frame,
+ * then draws the newest one. Frames published while it's drawing or
+ * waiting out DRIVER_RENDER_USEC are skipped, never queued, so a slow
+ * terminal costs frames instead of delaying the game. Frames taken while 
+ * a prompt is up are dropped; the game publishes a fresh one after it
+*/
+static void *render_main(void *arg) {
+    DriverRender *r = arg;
+    uint64_t next_frame_usec = 0;
+    bool stop = false;
+    while (!stop) {
+        struct pollfd pfd = {.fd = r->efd, .events = POLLIN};
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+            break;
+        uint64_t count;
+        ssize_t n = read(r->efd, &count, sizeof(count));
+        (void) n;
+        stop = atomic_load(&r->stop);
+
+        uint64_t now = monotonic_usec();
+        if (!stop && now < next_frame_usec) {
+            struct timespec ts = {.tv_sec = next_frame_usec / 1000000, \
+                .tv_nsec = (next_frame_usec % 1000000) * 1000};
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+
+        const TetrisFrame *f;
+        if (tg_frames_latest(&r->frames, &f)) {
+            pthread_mutex_lock(&r->term_lock);
+            if (!r->prompting)
+                ansi_draw(ansi_term, f);
+            pthread_mutex_unlock(&r->term_lock);
+        }
+        next_frame_usec = monotonic_usec() + DRIVER_RENDER_USEC;
+    }
+    return NULL;
+}
+
+/**
+ * Put up an ANSI prompt over the board, holding off the render thread 
+ * until driver_prompt_done() so a frame it's about to draw can't cover it
+*/
+static void driver_prompt(const char *text) {
+    term_lock();
+    if (render)
+        render->prompting = true;
+    ansi_message(ansi_term, TETRIS_ROWS / 10, text);
+    term_unlock();
+}
+
+/**
+ * Let the render thread draw again after driver_prompt(). The next frame 
+ * redraws the board in full, since ansi_message() invalidated it
+*/
+static void driver_prompt_done(void) {
+    term_lock();
+    if (render)
+        render->prompting = false;
+    term_unlock();
+}
+
+/**
+ * Write `text` on the status line under the score, replacing what was 
+ * there; "" clears it
+*/
+static void driver_status(WINDOW *s_win, const char *text) {
+    if (ansi_term) {
+        term_lock();
+        ansi_status(ansi_term, text);
+        term_unlock();
+    }
+    else {
+        mvwprintw(s_win, 4, 1, "%-*s", SCORE_WIN_COLS - 2, text);
+        wrefresh(s_win);
+    }
+}
+
+/**
+ * Hand the game's current state to the render thread
+*/
+static void render_publish(DriverRender *r, const TetrisGame *tg) {
+    tg_frames_publish_game(&r->frames, tg);
+    uint64_t one = 1;
+    ssize_t n = write(r->efd, &one, sizeof(one));
+    (void) n;
+}
+
+/**
+ * Translate an ansi_getch() key to what ncurses' getch() returns for it
+*/
+static int ansi_to_curses_key(int ch) {
+    switch (ch) {
+        case -1:
+            return ERR;
+        case ANSI_KEY_UP:
+            return KEY_UP;
+        case ANSI_KEY_DOWN:
+            return KEY_DOWN;
+        case ANSI_KEY_LEFT:
+            return KEY_LEFT;
+        case ANSI_KEY_RIGHT:
+            return KEY_RIGHT;
+        default:
+            return ch;
+    }
+}
+
+/**
+ * Next key waiting from whichever backend is drawing, or ERR
+*/
+static int driver_getch(void) {
+    if (ansi_term)
+        return ansi_to_curses_key(ansi_getch(ansi_term));
+    return getch();
+}
+
+/**
+ * Block for a keypress, for the pause and quit prompts
+*/
+static int wait_for_key(void) {
+    if (ansi_term)
+        return ansi_to_curses_key(ansi_wait_key(ansi_term));
+    timeout(-1);
+    int ch = getch();
+    timeout(0);
+    return ch;
+}
+
+int main(int argc, char **argv) {
+    const char *replay_file = NULL;
+    bool use_ansi = false, ansi_sync = false, use_render_thread = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:ast")) != -1) {
+        switch (opt) {
+            case 'r':
+                replay_file = optarg;
+                break;
+            case 'a':
+                use_ansi = true;
+                break;
+            case 's':
+                ansi_sync = true;
+                break;
+            case 't':
+                use_render_thread = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r replay_file] [-a [-s] [-t]]\n", argv[0]);
+                return 1;
+        }
+    }
+    // ncurses isn't thread safe, so only the ANSI backend can draw from 
+    //  another thread
+    if (use_render_thread && !use_ansi) {
+        fprintf(stderr, "-t needs -a\n");
+        return 1;
+    }
+
+    WINDOW *g_win = NULL, *s_win = NULL;      // game and score windows
+    static AnsiTerm term;
+    if (use_ansi) {
+        if (!ansi_open(&term, STDIN_FILENO, STDOUT_FILENO, ansi_sync)) {
+            fprintf(stderr, "-a needs a terminal on stdin\n");
+            return 1;
+        }
+        ansi_term = &term;
+    }
+    else {
+        // set up ncurses
+        initscr();
+        cbreak();
+        noecho();       // dont echo key presses to screen
+        keypad(stdscr, TRUE);    // enable use of arrow and function keys
+        curs_set(0);   // don't show cursor on screen 
+        timeout(0);         // dont block on getch()
+        nodelay(stdscr, TRUE);
+        // getmaxyx(stdscr, row, col);      // get window size to int row, int col
+
+        // refresh();
+
+        const int winheight = TETRIS_ROWS;
+        const int winwidth = BLOCK_WIDTH * TETRIS_COLS;
+        // ncurses window def: WINDOW *newwin(int nlines, int ncols, int begin_y, int begin_x);
+        g_win = newwin(winheight + 2, winwidth + 2, 2, 2);        // creates game window
+
+        nc_init_colors();
+        s_win = newwin(SCORE_WIN_ROWS, SCORE_WIN_COLS, 2, winwidth + 5); // score window
+        box(g_win, 0,0);
+        box(s_win, 0,0);
+
+        wrefresh(g_win);
+        wrefresh(s_win);
+
+        // CREATE DEBUG WINDOW
+        #ifdef DEBUG_T_WIN
+        dbg_win = newwin(winheight + 2 - SCORE_WIN_ROWS,  SCORE_WIN_COLS, \
+         2 + SCORE_WIN_ROWS, winwidth + 5); // score window
+        box(dbg_win, 0, 0);
+        wrefresh(dbg_win);
+
+        #endif
+    }
 
     
 
-    tg = create_game();
+    // the loop sleeps in poll() until a key comes in or the timer goes off
+    //  for the next gravity tick, so an idle game costs no CPU and keys are 
+    //  handled as soon as they arrive
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (tfd < 0) {
+        if (ansi_term)
+            ansi_close(ansi_term);
+        else
+            endwin();
+        perror("timerfd_create");
+        return 1;
+    }
+
+    // -t: ticks stay on this thread, drawing moves to the render thread
+    static DriverRender render_state;
+    if (use_render_thread) {
+        tg_frames_init(&render_state.frames);
+        pthread_mutex_init(&render_state.term_lock, NULL);
+        render_state.prompting = false;
+        atomic_init(&render_state.stop, false);
+        render_state.efd = eventfd(0, EFD_CLOEXEC);
+        if (render_state.efd < 0 || \
+            pthread_create(&render_state.thread, NULL, render_main, &render_state) != 0) {
+            ansi_close(ansi_term);
+            close(tfd);
+            fprintf(stderr, "couldn't start the render thread\n");
+            return 1;
+        }
+        render = &render_state;
+    }
+
+    // recorded games run on the frame clock so the replay reproduces gravity 
+    //  exactly. Frames are laid out every DRIVER_FRAME_USEC from 
+    //  frame_origin_usec, and the frames nothing happened in are caught up 
+    //  on with T_NONE ticks whenever the loop wakes
+    TetrisReplay replay;
+    if (replay_file)
+        tg = replay_start(&replay, (uint64_t) rand(), TG_RANDOM_UNIFORM, DRIVER_FRAME_USEC);
+    else {
+        tg = create_game();
+        tg_set_clock(tg, TG_CLOCK_MONOTONIC);   // same clock as the timerfd
+        create_rand_piece(tg);      // create first piece
+    }
+    uint64_t frame_origin_usec = monotonic_usec();
     enum player_move move = T_NONE;
-    create_rand_piece(tg);      // create first piece
+    TetrisInputQueue input;
+    tg_input_init(&input);
+    DriverScreen screen = {.board_valid = false, .score_valid = false};
+    uint64_t status_until_usec = 0;     // when the status line comes down, 0 if it's empty
 
     #ifdef DEBUG_T
     fprintf(gamelog, "========================================\n");
@@ -73,94 +415,151 @@ int main(void) {
     fflush(gamelog);
     #endif
 
+    struct pollfd fds[2] = {
+        {.fd = STDIN_FILENO, .events = POLLIN},
+        {.fd = tfd, .events = POLLIN},
+    };
+
     // while game is running and player hasn't tried to quit
     while (!tg->game_over && move != T_QUIT) {
 
+        if (status_until_usec && monotonic_usec() >= status_until_usec) {
+            driver_status(s_win, "");
+            status_until_usec = 0;
+        }
 
-        // this function handles basically everything about the internal game state. 
-        // all the driver really has to do is pass `move` along to it and then print out
-        //  the tg->active_board array in whatever format is desired
-        tg_tick(tg, move);
-
-        // display board
-        display_board(g_win, tg->active_board);
-        update_score(s_win, tg);
-
-        switch(getch()) {
-            case KEY_UP:
-                move = T_UP;
-                break;
-            case KEY_DOWN:
-                move = T_DOWN;
-                break;
-            case KEY_LEFT:
-                move = T_LEFT;
-                break;
-            case KEY_RIGHT:
-                move = T_RIGHT;
-                break;
-            case ' ':   // SPACE pauses game
-                // move = T_PLAYPAUSE;
-                // align "PAUSED" text in game window ; window, y, x
-                wmove(g_win, (TETRIS_ROWS / 10), (TETRIS_COLS * BLOCK_WIDTH / 2) -2);
-                wprintw(g_win, "PAUSED");
-                wrefresh(g_win);
-                // change getch() back to blocking so pause holds until resumed
-                timeout(-1);
-                getch();
-                timeout(0);
-                move = T_NONE;
+        // display board. Only what changed since the last pass goes out, 
+        //  and nothing at all if the game didn't change
+        if (render)
+            render_publish(render, tg);
+        else if (ansi_term) {
+            TetrisFrame frame;
+            tg_frame_capture(tg, &frame);
+            ansi_draw(ansi_term, &frame);
+        }
+        else {
+            bool board_drawn = display_board(g_win, tg, &screen);
+            if (update_score(s_win, tg, &screen) || board_drawn)
+                doupdate();
+        }
 
-                break;
+        // wake for the next tick, or sooner to take the status line down
+        uint64_t wake_usec = next_tick_deadline_usec(tg, frame_origin_usec);
+        if (status_until_usec && status_until_usec < wake_usec)
+            wake_usec = status_until_usec;
+        arm_tick_timer(tfd, wake_usec);
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)     // eg a terminal resize
+                continue;
+            break;
+        }
+        if (fds[0].revents & (POLLHUP | POLLERR)) {
+            move = T_QUIT;  // the terminal went away
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t expirations;
+            ssize_t n = read(tfd, &expirations, sizeof(expirations));
+            (void) n;
+        }
 
-            // Quit game
-            case 'q':
-                wclear(g_win);
-                box(g_win,0,0);
-                wmove(g_win, (TETRIS_ROWS / 10), (TETRIS_COLS * BLOCK_WIDTH / 2) -4);
-                wprintw(g_win, "QUIT? [Yy/Nn]");
-                wrefresh(g_win);
-                // change getch() back to blocking so pause holds until resumed
-                timeout(-1);
-                char response = getch();
-
-                if (response == 'y' || response == 'Y' || \
-                    response == ' ' || response == 'q') {
-                    move = T_QUIT;
+        // queue every key that's waiting, then run one tick with all of them, 
+        //  or the tick the timer woke us for
+        int ch;
+        while (move != T_QUIT && (fds[0].revents & POLLIN) && (ch = driver_getch()) != ERR) {
+            uint64_t key_usec = monotonic_usec();
+            move = T_NONE;
+            switch(ch) {
+                case KEY_UP:
+                    move = T_UP;
+                    break;
+                case KEY_DOWN:
+                    move = T_DOWN;
+                    break;
+                case KEY_LEFT:
+                    move = T_LEFT;
+                    break;
+                case KEY_RIGHT:
+                    move = T_RIGHT;
+                    break;
+                case 'x':   // hard drop
+                    move = T_HARDDROP;
+                    break;
+                case ' ': { // SPACE pauses game
+                    // move = T_PLAYPAUSE;
+                    // moves from before the pause go in before it
+                    driver_tick(replay_file ? &replay : NULL, tg, &input, frame_origin_usec);
+                    if (ansi_term)
+                        driver_prompt("PAUSED");
+                    else {
+                        // align "PAUSED" text in game window ; window, y, x
+                        wmove(g_win, (TETRIS_ROWS / 10), (TETRIS_COLS * BLOCK_WIDTH / 2) -2);
+                        wprintw(g_win, "PAUSED");
+                        wrefresh(g_win);
+                    }
+                    // hold until resumed; replay frames don't run while paused
+                    wait_for_key();
+                    if (ansi_term)
+                        driver_prompt_done();
+                    frame_origin_usec += monotonic_usec() - key_usec;
+                    screen.board_valid = false;     // redraw over "PAUSED"
                     break;
                 }
-                else {
-                    move = T_NONE;
+
+                // Quit game
+                case 'q': {
+                    if (ansi_term)
+                        driver_prompt("QUIT? [Yy/Nn]");
+                    else {
+                        wclear(g_win);
+                        box(g_win,0,0);
+                        wmove(g_win, (TETRIS_ROWS / 10), (TETRIS_COLS * BLOCK_WIDTH / 2) -4);
+                        wprintw(g_win, "QUIT? [Yy/Nn]");
+                        wrefresh(g_win);
+                    }
+                    int response = wait_for_key();
+                    if (ansi_term)
+                        driver_prompt_done();
+                    frame_origin_usec += monotonic_usec() - key_usec;
+                    screen.board_valid = false;
+
+                    if (response == 'y' || response == 'Y' || \
+                        response == ' ' || response == 'q') {
+                        move = T_QUIT;
+                    }
+                    break;
                 }
+                // save game to disk
+                case 'p':
+                    save_game_state(tg, "gamestate.ini");
+                    driver_status(s_win, "GAME STATE SAVED");
+                    status_until_usec = key_usec + DRIVER_STATUS_USEC;
+                    #ifdef DEBUG_T
+                    fprintf(gamelog, "game state saved to file gamestate.ini\n");
+                    #endif
+                     
+                    break;
+                // load game from disk
+                case 'l':
+                    // IMPLEMENT
+                    break;
+                default:
+                    break;
+            }
 
-                timeout(0);
-                break;
-            // save game to disk
-            case 'p':
-                move = T_NONE;
-                save_game_state(tg, "gamestate.ini");
-                mvwprintw(s_win, 4,1, "GAME STATE SAVED\n");
-                #ifdef DEBUG_T
-                fprintf(gamelog, "game state saved to file gamestate.ini\n");
-                #endif
-                wnoutrefresh(s_win);
-                 
-                break;
-            // load game from disk
-            case 'l':
-                move = T_NONE;
-                // IMPLEMENT
-                break;
-            default:
-                move = T_NONE;
-        }
-        sleep_millis(10);       // delay for 10ms (will be replaced with ISR)
+            // print keypress for debugging
+            #ifdef DEBUG_T
+            if (move != T_NONE) print_keypress(move);
+            #endif
 
-        // print keypress for debugging
-        #ifdef DEBUG_T
-        if (move != T_NONE) print_keypress(move);
-        #endif
+            if (move != T_NONE && move != T_QUIT)
+                tg_input_push(&input, key_usec, move);
+        }
+        if (move != T_QUIT)
+            driver_tick(replay_file ? &replay : NULL, tg, &input, frame_origin_usec);
     }
+    close(tfd);
+
     #ifdef DEBUG_T
     // for debugging, save state when game exits
     save_game_state(tg, "final-gamestate.ini");
@@ -168,74 +567,105 @@ int main(void) {
 
 
     // if we're here, game is over; dealloc tg
-    end_game(tg);
-    endwin();
+    if (render) {
+        // let the render thread draw the final frame and finish
+        atomic_store(&render->stop, true);
+        render_publish(render, tg);
+        pthread_join(render->thread, NULL);
+        close(render->efd);
+        pthread_mutex_destroy(&render->term_lock);
+        render = NULL;
+    }
+    if (ansi_term)
+        ansi_close(ansi_term);
+    else
+        endwin();
 
     printf("Game over! Level=%d, Score=%d\n", tg->level, tg->score);
+    #ifdef TETRIS_STATS
+    tg_dump_stats(tg, stdout);
+    #endif
+    if (replay_file) {
+        if (replay_finish(&replay, tg) && replay_save(&replay, replay_file))
+            printf("Replay saved to %s (%zu bytes)\n", replay_file, replay.len);
+        else
+            printf("Failed to save replay to %s\n", replay_file);
+        replay_free(&replay);
+    }
+    end_game(tg);
 
 }
 
 /**
- * Draw board array presented by tetris game
+ * Draw the game's active_board, sending only the cells that differ from 
+ * what `scr` says is on screen. Only stages the changes, the caller flushes 
+ * them with doupdate()
+ * @returns false if nothing changed and nothing was drawn
 */
-void display_board(WINDOW *w, TetrisBoard tb) {
-
-    static struct timeval last_update;
-
-    struct timeval curr_time_usec;
-    gettimeofday(&curr_time_usec, NULL);
-    int32_t usec_timediff = curr_time_usec.tv_usec - last_update.tv_usec; 
-    // if it flows below zero, (seconds ticks over, but us doesn't) just run it
-    if (usec_timediff > SCREEN_REFRESH_INTERVAL_USEC || usec_timediff < 0) {
+bool display_board(WINDOW *w, const TetrisGame *tg, DriverScreen *scr) {
+    if (scr->board_valid && scr->active_board_gen == tg->active_board_gen)
+        return false;
 
+    if (!scr->board_valid) {
         werase(w);
         box(w, 0,0);
-        // draw existing pieces on board
-        for (int i = 0; i < TETRIS_ROWS; i++) {
-            // move ncurses cursor
-            wmove(w, 1 + i, 1);
-            for (int j = 0; j < TETRIS_COLS; j++) {
-
-                if (tb.board[i][j] >= 0) {
-                    ADD_BLOCK(w, tb.board[i][j]);
-                }
-                else {
-                    ADD_EMPTY(w);
-                }
+    }
+    // draw cells that changed
+    for (int i = 0; i < TETRIS_ROWS; i++) {
+        for (int j = 0; j < TETRIS_COLS; j++) {
+            int8_t cell = tg->active_board.board[i][j];
+            if (scr->board_valid && scr->cells[i][j] == cell)
+                continue;
 
+            // move ncurses cursor
+            wmove(w, 1 + i, 1 + j * BLOCK_WIDTH);
+            if (cell >= 0) {
+                ADD_BLOCK(w, cell);
             }
+            else {
+                ADD_EMPTY(w);
+            }
+            scr->cells[i][j] = cell;
         }
+    }
+    scr->active_board_gen = tg->active_board_gen;
+    scr->board_valid = true;
 
-        last_update = curr_time_usec;
-        wrefresh(w);
+    wnoutrefresh(w);
 
-        #ifdef DEBUG_T
-        // fprintf(gamelog, "display_board()\n");
-        // print_board_state(*tb, gamelog);
-        // fflush(gamelog);
-        #endif
+    #ifdef DEBUG_T_WIN
+    refresh_debug_var_window(dbg_win);
+    #endif
 
-        #ifdef DEBUG_T_WIN
-        refresh_debug_var_window(dbg_win);
+    return true;
+}
 
 
-        #endif
+/**
+ * Rewrite the score window if the score, level, or lines changed. Like
+ * display_board(), it only stages the update
+ * @returns false if nothing changed
+*/
+bool update_score(WINDOW *w, const TetrisGame *tg, DriverScreen *scr) {
+    if (scr->score_valid && scr->score == tg->score && scr->level == tg->level && \
+        scr->lines_cleared_since_last_level == tg->lines_cleared_since_last_level)
+        return false;
 
-        // wnoutrefresh(w);
+    if (!scr->score_valid) {
+        werase(w);
+        box(w,0,0);
     }
- }
-
-
-void update_score(WINDOW *w, TetrisGame *tg) {
-    wclear(w);
-    box(w,0,0);
-    wmove(w, 1, 1);
-    mvwprintw(w, 1,1, "Score: %d\n", tg->score);
-    mvwprintw(w, 2,1, "Level: %d\n", tg->level);
-    mvwprintw(w, 3,1, "Lines until next Level: %d\n", 10 - tg->lines_cleared_since_last_level);
+    // pad the numbers so a shorter value covers up the longer one before it
+    mvwprintw(w, 1,1, "Score: %-10d", tg->score);
+    mvwprintw(w, 2,1, "Level: %-10d", tg->level);
+    mvwprintw(w, 3,1, "Lines until next Level: %-3d", 10 - tg->lines_cleared_since_last_level);
+    scr->score = tg->score;
+    scr->level = tg->level;
+    scr->lines_cleared_since_last_level = tg->lines_cleared_since_last_level;
+    scr->score_valid = true;
 
     wnoutrefresh(w);
-
+    return true;
 }
 
 
@@ -248,7 +678,7 @@ void print_keypress(enum player_move move) {
     // translate enum value into human-readable move
     #ifdef DEBUG_T
         char const* move_str[] =  {"T_NONE", "T_UP", "T_DOWN", "T_LEFT", \
-        "T_RIGHT", "T_PLAYPAUSE", "T_QUIT"};
+        "T_RIGHT", "T_PLAYPAUSE", "T_QUIT", "T_HARDDROP"};
         fprintf(gamelog, "Received move: %s\n", move_str[move]);
         fflush(gamelog);
     #endif
@@ -257,7 +687,7 @@ void print_keypress(enum player_move move) {
 
 
 void refresh_debug_var_window(WINDOW *w) {
-    wclear(w);
+    werase(w);
     box(w,0,0);
     wmove(w, 1, 1);
     TetrisPiece tp = tg->active_piece;
@@ -0,0 +1,73 @@
+/**
+ * Prints a binary event log from tetris_log.h as text
+ * @file logdump_tetris.c
+ * @brief Every record is printed as the line DEBUG_T used to write to
+ *  game.log directly. With -v each line is prefixed with the game it came
+ *  from and its game clock time, and -g keeps only one game's records.
+ * @author Jacob Bokor
+ * @date 03/2024
+ *
+ * Usage: tetris_logdump [-v] [-g game] game.tgl
+ */
+
+#include <unistd.h>     // getopt
+
+#include "tetris.h"
+#include "tetris_log.h"
+
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-v] [-g game] game.tgl\n", prog);
+    fprintf(stderr, "  -v       prefix lines with game id and game clock usec\n");
+    fprintf(stderr, "  -g game  only print records from this game id\n");
+}
+
+
+int main(int argc, char **argv) {
+    bool verbose = false;
+    long game = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "vg:h")) != -1) {
+        switch (opt) {
+            case 'v':
+                verbose = true;
+                break;
+            case 'g':
+                game = strtol(optarg, NULL, 10);
+                break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (argc - optind != 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[optind], "rb");
+    if (in == NULL) {
+        fprintf(stderr, "couldn't open '%s'\n", argv[optind]);
+        return 1;
+    }
+    if (!tg_log_read_header(in)) {
+        fprintf(stderr, "'%s' isn't a tetris event log of version %d\n", argv[optind], TG_LOG_VERSION);
+        fclose(in);
+        return 1;
+    }
+
+    TetrisLogRecord recs[256];
+    size_t n;
+    while ((n = fread(recs, sizeof(TetrisLogRecord), 256, in)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            if (game >= 0 && recs[i].game != game)
+                continue;
+            if (verbose)
+                printf("[game %u @ %llu] ", recs[i].game, (unsigned long long) recs[i].usec);
+            tg_log_format(&recs[i], stdout);
+        }
+    }
+
+    fclose(in);
+    return 0;
+}
@@ -0,0 +1,397 @@
+/**
+ * Headless batch simulator for the tetris game library
+ * @file sim_tetris.c
+ * @brief Runs many independent games across a pool of worker threads,
+ *  without ncurses, and reports throughput and score/level distributions.
+ *  Games use the frame clock, so they run at full CPU speed and are
+ *  reproducible from the batch seed.
+ * @author Jacob Bokor
+ * @date 03/2024
+ *
+ * Usage: tetris_sim [-g games] [-t threads] [-s seed] [-m max_ticks]
+ *                   [-f frame_usec] [-p policy] [-j ai_threads] [-b]
+ *        tetris_sim -R replay_file
+ */
+
+#include <unistd.h>     // getopt
+
+#include "sim_tetris.h"
+
+
+/////////////// MOVE POLICIES ////////////////
+
+/**
+ * Policy that never presses anything; pieces only fall with gravity
+*/
+static enum player_move policy_none_move(TetrisGame *tg, void *state) {
+    (void) tg;
+    (void) state;
+    return T_NONE;
+}
+
+/**
+ * Random policy state is a single xorshift64 word per worker
+*/
+static void *policy_random_create(const sim_config *cfg) {
+    (void) cfg;
+    return malloc(sizeof(uint64_t));
+}
+
+static void policy_random_new_game(void *state, uint64_t seed) {
+    // xorshift state must be nonzero
+    *(uint64_t*) state = (seed * 0x9E3779B97F4A7C15ULL) | 1;
+}
+
+/**
+ * Policy that mashes random rotate/translate moves every tick
+*/
+static enum player_move policy_random_move(TetrisGame *tg, void *state) {
+    (void) tg;
+    uint64_t *x = state;
+    *x ^= *x << 13;
+    *x ^= *x >> 7;
+    *x ^= *x << 17;
+
+    const enum player_move moves[] = {T_NONE, T_UP, T_DOWN, T_LEFT, T_RIGHT};
+    return moves[(*x >> 32) % (sizeof(moves) / sizeof(moves[0]))];
+}
+
+/**
+ * Beam search autoplayer from ai_tetris.h, with default weights
+*/
+static void *policy_ai_create(const sim_config *cfg) {
+    ai_config ai_cfg = ai_default_config();
+    ai_cfg.num_threads = cfg->ai_threads;
+    return ai_create(&ai_cfg);
+}
+
+static void policy_ai_new_game(void *state, uint64_t seed) {
+    (void) seed;
+    ai_reset(state);
+}
+
+static enum player_move policy_ai_move(TetrisGame *tg, void *state) {
+    return ai_next_move(state, tg);
+}
+
+static void policy_ai_destroy(void *state) {
+    ai_destroy(state);
+}
+
+static const sim_policy sim_policies[] = {
+    {"random", policy_random_create, policy_random_new_game, policy_random_move, free},
+    {"none", NULL, NULL, policy_none_move, NULL},
+    {"ai", policy_ai_create, policy_ai_new_game, policy_ai_move, policy_ai_destroy},
+};
+
+
+/**
+ * Look up a move policy by name
+ * @returns policy, or NULL if no policy has that name
+*/
+const sim_policy *sim_find_policy(const char *name) {
+    for (size_t i = 0; i < sizeof(sim_policies) / sizeof(sim_policies[0]); i++) {
+        if (strcmp(sim_policies[i].name, name) == 0)
+            return &sim_policies[i];
+    }
+    return NULL;
+}
+
+
+/////////////// SIMULATION ////////////////
+
+/**
+ * Play game number `game_idx` of the batch to completion, in a slot 
+ * from the worker's game pool
+*/
+sim_game_result sim_play_game(const sim_config *cfg, uint32_t game_idx, void *policy_state, \
+    TetrisGamePool *pool) {
+    sim_game_result res = {0};
+
+    // every game gets its own seed, so results don't depend on which
+    //  worker ran it or in what order
+    TetrisGame *tg = tg_pool_acquire(pool, cfg->seed + game_idx);
+    if (tg == NULL) {
+        res.failed = true;
+        return res;
+    }
+    tg_set_randomizer(tg, cfg->randomizer);
+    tg_set_frame_clock(tg, cfg->frame_usec);
+    create_rand_piece(tg);
+    if (cfg->policy->new_game)
+        cfg->policy->new_game(policy_state, cfg->seed + game_idx);
+
+    enum player_move move = T_NONE;
+    while (res.ticks < cfg->max_ticks) {
+        res.ticks++;
+        if (!tg_tick(tg, move)) {
+            res.topped_out = true;
+            break;
+        }
+        move = cfg->policy->next_move(tg, policy_state);
+    }
+
+    res.score = tg->score;
+    res.level = tg->level;
+    tg_pool_release(pool, tg);
+
+    return res;
+}
+
+/**
+ * Worker thread: claims game indices until the batch is done. Results are
+ * written to the game's own slot, so no locking is needed
+*/
+void *sim_worker_run(void *arg) {
+    sim_worker *w = arg;
+    const sim_config *cfg = w->cfg;
+
+    void *policy_state = NULL;
+    if (cfg->policy->create) {
+        policy_state = cfg->policy->create(cfg);
+        if (policy_state == NULL) {
+            fprintf(stderr, "worker %u: couldn't create '%s' policy\n", w->id, cfg->policy->name);
+            w->failed = true;
+            return NULL;
+        }
+    }
+
+    // games are played one at a time, so one slot gets reused for the 
+    //  whole batch instead of a malloc/free per game
+    TetrisGamePool *pool = tg_pool_create(1);
+    if (pool == NULL) {
+        fprintf(stderr, "worker %u: couldn't allocate game pool\n", w->id);
+        w->failed = true;
+    }
+
+    unsigned int game_idx;
+    while (pool != NULL && (game_idx = atomic_fetch_add(w->next_game, 1)) < cfg->num_games) {
+        w->results[game_idx] = sim_play_game(cfg, game_idx, policy_state, pool);
+        if (w->results[game_idx].failed) {
+            fprintf(stderr, "worker %u: game pool exhausted at game %u\n", w->id, game_idx);
+            w->failed = true;
+            break;
+        }
+    }
+
+    if (pool != NULL)
+        tg_pool_destroy(pool);
+
+    if (cfg->policy->destroy)
+        cfg->policy->destroy(policy_state);
+
+    return NULL;
+}
+
+
+/////////////// REPORTING ////////////////
+
+static int cmp_uint32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*) a;
+    uint32_t y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Print throughput and score/level distributions for a finished batch
+*/
+void sim_print_report(FILE *out, const sim_config *cfg, const sim_game_result *results, \
+    double elapsed_sec) {
+
+    uint64_t total_ticks = 0;
+    uint64_t total_score = 0;
+    uint32_t topped_out = 0;
+    uint32_t level_hist[SIM_MAX_LEVEL_BUCKETS] = {0};
+    uint32_t *scores = malloc(cfg->num_games * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < cfg->num_games; i++) {
+        total_ticks += results[i].ticks;
+        total_score += results[i].score;
+        topped_out += results[i].topped_out;
+        scores[i] = results[i].score;
+
+        // last bucket collects every level past the end of the histogram
+        uint32_t bucket = results[i].level;
+        if (bucket >= SIM_MAX_LEVEL_BUCKETS)
+            bucket = SIM_MAX_LEVEL_BUCKETS - 1;
+        level_hist[bucket]++;
+    }
+    qsort(scores, cfg->num_games, sizeof(uint32_t), cmp_uint32);
+
+    fprintf(out, "policy=%s games=%u threads=%u seed=%llu frame_usec=%u randomizer=%s\n", \
+        cfg->policy->name, cfg->num_games, cfg->num_threads, (unsigned long long) cfg->seed, \
+        cfg->frame_usec, cfg->randomizer == TG_RANDOM_7BAG ? "7bag" : "uniform");
+    fprintf(out, "elapsed: %.3f s\n", elapsed_sec);
+    fprintf(out, "games/sec: %.1f\n", cfg->num_games / elapsed_sec);
+    fprintf(out, "ticks/sec: %.0f  (total ticks %llu)\n", total_ticks / elapsed_sec, \
+        (unsigned long long) total_ticks);
+    fprintf(out, "topped out: %u/%u (rest hit max_ticks=%llu)\n", topped_out, cfg->num_games, \
+        (unsigned long long) cfg->max_ticks);
+
+    fprintf(out, "score: mean=%.1f min=%u p10=%u p50=%u p90=%u p99=%u max=%u\n", \
+        (double) total_score / cfg->num_games, scores[0], \
+        scores[cfg->num_games / 10], scores[cfg->num_games / 2], \
+        scores[cfg->num_games * 9 / 10], scores[cfg->num_games * 99 / 100], \
+        scores[cfg->num_games - 1]);
+
+    fprintf(out, "level histogram:\n");
+    for (int i = 0; i < SIM_MAX_LEVEL_BUCKETS; i++) {
+        if (level_hist[i] == 0)
+            continue;
+        fprintf(out, "  level %2d%s: %u\n", i, i == SIM_MAX_LEVEL_BUCKETS - 1 ? "+" : " ", \
+            level_hist[i]);
+    }
+
+    free(scores);
+}
+
+
+/**
+ * Re-execute a recorded game and check it ends the way it was recorded
+ * @returns process exit code, 0 if the replay matched
+*/
+static int sim_verify_replay(const char *filename) {
+    TetrisReplay rp;
+    if (!replay_load(&rp, filename)) {
+        fprintf(stderr, "couldn't load replay '%s'\n", filename);
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    TetrisReplayResult res = replay_run(&rp);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    const char *status_str[] = {"OK", "MISMATCH", "CORRUPT"};
+    printf("replay=%s seed=%llu bytes=%zu status=%s\n", filename, \
+        (unsigned long long) rp.seed, rp.len, status_str[res.status]);
+    printf("ticks: %llu in %.3f s\n", (unsigned long long) res.ticks, elapsed);
+    if (res.status != REPLAY_CORRUPT) {
+        printf("score: %u (recorded %u)\n", res.score, res.expected_score);
+        printf("level: %u (recorded %u)\n", res.level, res.expected_level);
+        printf("board hash: %016llx (recorded %016llx)\n", \
+            (unsigned long long) res.hash, (unsigned long long) res.expected_hash);
+    }
+
+    replay_free(&rp);
+    return res.status == REPLAY_OK ? 0 : 1;
+}
+
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-g games] [-t threads] [-s seed] [-m max_ticks] "
+        "[-f frame_usec] [-p policy] [-j ai_threads] [-b]\n", prog);
+    fprintf(stderr, "       %s -R replay_file\n", prog);
+    fprintf(stderr, "  -j  search threads per game for the ai policy\n");
+    fprintf(stderr, "  -R  re-run a recorded game and verify its final score and board\n");
+    fprintf(stderr, "  -b  deal pieces from a 7-bag instead of uniform random\n");
+    fprintf(stderr, "  policies:");
+    for (size_t i = 0; i < sizeof(sim_policies) / sizeof(sim_policies[0]); i++)
+        fprintf(stderr, " %s", sim_policies[i].name);
+    fprintf(stderr, "\n");
+}
+
+
+int main(int argc, char **argv) {
+    sim_config cfg = {
+        .num_games = SIM_DEFAULT_GAMES,
+        .num_threads = SIM_DEFAULT_THREADS,
+        .seed = SIM_DEFAULT_SEED,
+        .max_ticks = SIM_DEFAULT_MAX_TICKS,
+        .frame_usec = SIM_DEFAULT_FRAME_USEC,
+        .randomizer = TG_RANDOM_UNIFORM,
+        .policy = &sim_policies[0],
+        .ai_threads = AI_DEFAULT_THREADS,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "g:t:s:m:f:p:j:R:bh")) != -1) {
+        switch (opt) {
+            case 'g':
+                cfg.num_games = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                cfg.num_threads = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                cfg.seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'm':
+                cfg.max_ticks = strtoull(optarg, NULL, 10);
+                break;
+            case 'f':
+                cfg.frame_usec = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                cfg.policy = sim_find_policy(optarg);
+                if (cfg.policy == NULL) {
+                    fprintf(stderr, "unknown policy '%s'\n", optarg);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'j':
+                cfg.ai_threads = strtoul(optarg, NULL, 10);
+                break;
+            case 'R':
+                return sim_verify_replay(optarg);
+            case 'b':
+                cfg.randomizer = TG_RANDOM_7BAG;
+                break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (cfg.num_games == 0 || cfg.num_threads == 0 || cfg.num_threads > SIM_MAX_THREADS) {
+        fprintf(stderr, "need at least 1 game and 1-%d threads\n", SIM_MAX_THREADS);
+        return 1;
+    }
+    if (cfg.ai_threads == 0 || cfg.ai_threads > AI_MAX_THREADS) {
+        fprintf(stderr, "need 1-%d ai threads\n", AI_MAX_THREADS);
+        return 1;
+    }
+
+    sim_game_result *results = calloc(cfg.num_games, sizeof(sim_game_result));
+    if (results == NULL) {
+        fprintf(stderr, "couldn't allocate results for %u games\n", cfg.num_games);
+        return 1;
+    }
+    sim_worker workers[SIM_MAX_THREADS];
+    atomic_uint next_game = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    uint32_t started = 0;
+    bool failed = false;
+    for (; started < cfg.num_threads; started++) {
+        workers[started] = (sim_worker) {.id = started, .cfg = &cfg, .results = results, \
+            .next_game = &next_game};
+        if (pthread_create(&workers[started].thread, NULL, sim_worker_run, &workers[started]) != 0) {
+            fprintf(stderr, "couldn't start worker thread %u\n", started);
+            // the workers already running stop after their current game
+            atomic_store(&next_game, cfg.num_games);
+            failed = true;
+            break;
+        }
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        failed |= workers[i].failed;
+    }
+    if (failed) {
+        free(results);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed_sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    sim_print_report(stdout, &cfg, results, elapsed_sec);
+
+    free(results);
+    return 0;
+}
@@ -62,8 +62,9 @@ static int handler(void* user, const char* section, const char* name,
             // some manual manipulation needed here since both vals on one line
             char *timeval_str = strdup(value);
 
-            tg->last_gravity_tick_usec.tv_sec = atoi(strtok(timeval_str,","));
-            tg->last_gravity_tick_usec.tv_usec = atoi(strtok(NULL, ","));
+            // stored as sec,usec like a `struct timeval`
+            tg->last_gravity_tick_usec = (uint64_t) atoll(strtok(timeval_str,",")) * 1000000;
+            tg->last_gravity_tick_usec += atoi(strtok(NULL, ","));
             free(timeval_str);
 
         } else if (MATCH_KEY("active_board_highest_occupied_cell")) {
@@ -132,6 +133,11 @@ bool restore_game_state(TetrisGame *tg, const char* filename, FILE *gamelog) {
     }
     fprintf(gamelog, "Config loaded from %s!\n", filename);
 
+    // boards were written cell by cell, bring the occupancy bitboards back in sync
+    rebuild_board_occupancy(&tg->board);
+    rebuild_board_occupancy(&tg->active_board);
+    tg_board_changed(tg);
+
     return true;
 
 }
@@ -201,7 +207,9 @@ void save_game_state(TetrisGame *tg, const char* filename) {
         fprintf(savefile, "level = %d\n", tg->level);
         fprintf(savefile, "lines_cleared_since_last_level = %d\n", tg->lines_cleared_since_last_level);
         fprintf(savefile, "gravity_tick_rate_usec = %d\n", tg->gravity_tick_rate_usec);
-        fprintf(savefile, "last_gravity_tick_usec = %ld,%ld\n", tg->last_gravity_tick_usec.tv_sec, tg->last_gravity_tick_usec.tv_usec);
+        fprintf(savefile, "last_gravity_tick_usec = %llu,%llu\n", \
+            (unsigned long long) (tg->last_gravity_tick_usec / 1000000), \
+            (unsigned long long) (tg->last_gravity_tick_usec % 1000000));
 
         fprintf(savefile, "\n[ACTIVE_PIECE]\n");
         fprintf(savefile, "ptype = %d\n", tg->active_piece.ptype);
@@ -0,0 +1,359 @@
+/**
+ * Invariant-checking fuzz harness for the tetris game library
+ * @file fuzz_tetris.c
+ * @brief Drives tg_tick() with random move streams on random garbage
+ *  boards and saved fixture boards, on the frame clock so it runs at full
+ *  speed and every failure reproduces from its seed. After every tick the
+ *  active piece must be in bounds, and after every lock the board's
+ *  derived state must match a rescan, no new full rows may be left, rows
+ *  must be cleared whole, and score and level must follow
+ *  points_per_line_cleared. The first violation is printed and the game
+ *  is saved to fuzz-failure.ini.
+ * @author Jacob Bokor
+ * @date 03/2024
+ *
+ * Usage: fuzz_tetris [-n ticks] [-s seed] [-f frame_usec] [fixture.ini ...]
+ */
+
+#include <unistd.h>     // getopt
+
+#include "tetris.h"
+#include "tetris_snapshot.h"
+#include "utils.h"
+
+
+#define FUZZ_DEFAULT_TICKS 10000000ULL
+#define FUZZ_DEFAULT_SEED 1
+#define FUZZ_DEFAULT_FRAME_USEC 50000
+// random boards start with up to this many rows of garbage
+#define FUZZ_MAX_GARBAGE_ROWS 20
+#define FUZZ_FAILURE_FILE "fuzz-failure.ini"
+
+
+static uint64_t fuzz_rand(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+/**
+ * Mostly nothing and sideways moves, so pieces travel before they land,
+ * with enough hard drops to lock a piece every few dozen ticks
+*/
+static enum player_move fuzz_move(uint64_t *s) {
+    uint32_t r = fuzz_rand(s) % 100;
+    if (r < 40)
+        return T_NONE;
+    if (r < 55)
+        return T_LEFT;
+    if (r < 70)
+        return T_RIGHT;
+    if (r < 82)
+        return T_UP;
+    if (r < 96)
+        return T_DOWN;
+    return T_HARDDROP;
+}
+
+static int count_cells(const TetrisBoard *tb) {
+    int cells = 0;
+    for (int row = 0; row < TETRIS_ROWS; row++)
+        cells += __builtin_popcount(TETRIS_ROW_MASK(tb, row) & ~TETRIS_EMPTY_ROW_MASK);
+    return cells;
+}
+
+static int count_full_rows(const TetrisBoard *tb) {
+    int full = 0;
+    for (int row = 0; row < TETRIS_ROWS; row++)
+        full += TETRIS_ROW_MASK(tb, row) == TETRIS_FULL_ROW_MASK;
+    return full;
+}
+
+// highest_occupied_cell from a scan, TETRIS_ROWS - 1 for an empty board like init_board()
+static uint8_t scan_highest_row(const TetrisBoard *tb) {
+    for (int row = 0; row < TETRIS_ROWS; row++) {
+        if (TETRIS_ROW_MASK(tb, row) != TETRIS_EMPTY_ROW_MASK)
+            return row;
+    }
+    return TETRIS_ROWS - 1;
+}
+
+/**
+ * Fill the bottom rows with garbage, leaving at least one hole in every 
+ * row so none start out full. Half the rows are full but for one hole, 
+ * and holes tend to line up, so random pieces still clear lines, 
+ * including several rows at a time with uncleared rows between them
+*/
+static void fuzz_garbage_board(TetrisGame *tg, uint64_t *s) {
+    int rows = fuzz_rand(s) % (FUZZ_MAX_GARBAGE_ROWS + 1);
+    int hole = fuzz_rand(s) % TETRIS_COLS;
+    for (int row = TETRIS_ROWS - 1; row >= TETRIS_ROWS - rows; row--) {
+        if (fuzz_rand(s) % 4 == 0)
+            hole = fuzz_rand(s) % TETRIS_COLS;
+        bool one_hole = fuzz_rand(s) % 2;
+        for (int col = 0; col < TETRIS_COLS; col++) {
+            bool filled = col != hole && (one_hole || fuzz_rand(s) % 4 != 0);
+            tg->board.board[row][col] = filled ? (int8_t) (fuzz_rand(s) % NUM_TETROMINOS) : BG_COLOR;
+        }
+    }
+    rebuild_board_occupancy(&tg->board);
+    tg->board.highest_occupied_cell = scan_highest_row(&tg->board);
+    tg_board_changed(tg);
+}
+
+/**
+ * Check the board state kept incrementally by the game logic against a
+ * rebuild from the color plane
+ * @returns name of the broken invariant, NULL if there isn't one
+*/
+static const char *check_board(const TetrisGame *tg) {
+    TetrisBoard scan = tg->board;
+    rebuild_board_occupancy(&scan);
+    if (memcmp(scan.occupancy, tg->board.occupancy, sizeof(scan.occupancy)) != 0)
+        return "occupancy masks out of sync with the board";
+    if (memcmp(scan.col_occupancy, tg->board.col_occupancy, sizeof(scan.col_occupancy)) != 0 || \
+        memcmp(scan.col_height, tg->board.col_height, sizeof(scan.col_height)) != 0 || \
+        scan.holes != tg->board.holes || scan.bumpiness != tg->board.bumpiness || \
+        scan.well_depth != tg->board.well_depth)
+        return "column metrics out of sync with the board";
+    if (scan.hash != tg->board.hash)
+        return "board hash out of sync with the board";
+    if (scan_highest_row(&tg->board) != tg->board.highest_occupied_cell)
+        return "highest_occupied_cell doesn't match a scan of the board";
+    return NULL;
+}
+
+/**
+ * Check the active piece is on the board and not inside the stack
+*/
+static const char *check_piece(const TetrisGame *tg) {
+    const TetrisPiece tp = tg->active_piece;
+    if (tp.ptype >= NUM_TETROMINOS || tp.orientation >= NUM_ORIENTATIONS)
+        return "active piece type or orientation out of range";
+    for (int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
+        int row = TETROMINOS[tp.ptype][tp.orientation][i].row + tp.loc.row;
+        int col = TETROMINOS[tp.ptype][tp.orientation][i].col + tp.loc.col;
+        if (row < 0 || row >= TETRIS_ROWS || col < 0 || col >= TETRIS_COLS)
+            return "active piece cell out of bounds";
+    }
+    if (!test_piece_position(&tg->board, tp))
+        return "active piece overlaps the stack";
+    return NULL;
+}
+
+/**
+ * State before a tick that locks a piece, to check the lock against
+*/
+typedef struct fuzz_lock_state {
+    int cells;
+    int full_rows;
+    uint32_t score;
+    uint32_t level;
+    uint8_t lines_cleared_since_last_level;
+} fuzz_lock_state;
+
+static fuzz_lock_state lock_state(const TetrisGame *tg) {
+    return (fuzz_lock_state) {
+        .cells = count_cells(&tg->board),
+        .full_rows = count_full_rows(&tg->board),
+        .score = tg->score,
+        .level = tg->level,
+        .lines_cleared_since_last_level = tg->lines_cleared_since_last_level,
+    };
+}
+
+/**
+ * Check a single piece lock: it added 4 cells and removed whole rows,
+ * left no new full rows, and scored those rows by points_per_line_cleared
+*/
+static const char *check_lock(const TetrisGame *tg, const fuzz_lock_state *before) {
+    int removed = before->cells + NUM_CELLS_IN_TETROMINO - count_cells(&tg->board);
+    if (removed < 0 || removed % TETRIS_COLS != 0 || removed / TETRIS_COLS > 4)
+        return "lock removed cells that aren't whole rows";
+    int lines = removed / TETRIS_COLS;
+    if (count_full_rows(&tg->board) > before->full_rows)
+        return "full row left on the board after a lock";
+
+    if (tg->score - before->score != before->level * points_per_line_cleared[lines])
+        return "score change doesn't match points_per_line_cleared";
+    uint32_t total_lines = before->lines_cleared_since_last_level + lines;
+    uint32_t want_level = before->level + (total_lines >= 10);
+    if (tg->level != want_level || tg->lines_cleared_since_last_level != total_lines % 10)
+        return "level or lines since last level don't match lines cleared";
+    return NULL;
+}
+
+static void report_failure(const TetrisGame *tg, const char *what, uint64_t seed, \
+    uint64_t game, uint64_t tick, const char *fixture) {
+    fprintf(stderr, "FAIL: %s\n", what);
+    fprintf(stderr, "  seed=%llu game=%llu tick=%llu board=%s\n", (unsigned long long) seed, \
+        (unsigned long long) game, (unsigned long long) tick, fixture ? fixture : "random");
+    fprintf(stderr, "  highest_occupied_cell=%d score=%u level=%u piece=%s at (%d, %d) o=%d\n", \
+        tg->board.highest_occupied_cell, tg->score, tg->level, get_piece_str(tg->active_piece.ptype), \
+        tg->active_piece.loc.row, tg->active_piece.loc.col, tg->active_piece.orientation);
+    print_board_state(tg->board, stderr, false);
+    save_game_state((TetrisGame *) tg, FUZZ_FAILURE_FILE);
+    fprintf(stderr, "  game saved to %s\n", FUZZ_FAILURE_FILE);
+}
+
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-n ticks] [-s seed] [-f frame_usec] [fixture.ini ...]\n", prog);
+    fprintf(stderr, "  games alternate between random garbage boards and the given fixtures\n");
+}
+
+
+int main(int argc, char **argv) {
+    uint64_t max_ticks = FUZZ_DEFAULT_TICKS;
+    uint64_t seed = FUZZ_DEFAULT_SEED;
+    uint32_t frame_usec = FUZZ_DEFAULT_FRAME_USEC;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:f:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                max_ticks = strtoull(optarg, NULL, 10);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'f':
+                frame_usec = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                print_usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    char **fixtures = &argv[optind];
+    int num_fixtures = argc - optind;
+
+    // parse every fixture once up front; INI loading costs more than
+    //  playing out most games
+    TetrisSnapshot *fixture_snaps = malloc((num_fixtures > 0 ? num_fixtures : 1) * sizeof(TetrisSnapshot));
+    if (fixture_snaps == NULL)
+        return 1;
+    for (int i = 0; i < num_fixtures; i++) {
+        TetrisGame *tg = create_game();
+        FILE *devnull = fopen("/dev/null", "w");
+        bool ok = restore_game_state(tg, fixtures[i], devnull ? devnull : stderr);
+        if (devnull)
+            fclose(devnull);
+        if (!ok) {
+            fprintf(stderr, "couldn't load fixture '%s'\n", fixtures[i]);
+            end_game(tg);
+            free(fixture_snaps);
+            return 1;
+        }
+        // fixtures are saved mid-game, restart gravity on the frame clock. 
+        //  Some were saved by builds with the highest_occupied_cell bugs, 
+        //  so only their cells are trusted
+        tg_set_frame_clock(tg, frame_usec);
+        tg->board.highest_occupied_cell = scan_highest_row(&tg->board);
+        tg->active_piece.falling = true;
+        tg_snapshot_save(tg, &fixture_snaps[i]);
+        end_game(tg);
+        // a fixture that can't be restored would leave every game started 
+        //  from it playing whatever the last game left in the buffer
+        if (!tg_snapshot_valid(&fixture_snaps[i])) {
+            fprintf(stderr, "fixture '%s' isn't a valid game state\n", fixtures[i]);
+            free(fixture_snaps);
+            return 1;
+        }
+    }
+
+    // xorshift can't start from 0
+    uint64_t rng = seed * 0x9E3779B97F4A7C15ULL + 1;
+    uint64_t ticks = 0, locks = 0, lines = 0, games = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // every game reuses one buffer
+    void *game_buf = malloc(sizeof(TetrisGame));
+    if (game_buf == NULL) {
+        free(fixture_snaps);
+        return 1;
+    }
+    int status = 0;
+
+    while (ticks < max_ticks && status == 0) {
+        TetrisGame *tg = create_game_seeded_in(game_buf, fuzz_rand(&rng));
+        tg_set_frame_clock(tg, frame_usec);
+
+        // every other game starts from a fixture, when there are any
+        const char *fixture = NULL;
+        if (num_fixtures > 0 && games % 2 == 1) {
+            int idx = (games / 2) % num_fixtures;
+            fixture = fixtures[idx];
+            if (!tg_snapshot_load(tg, &fixture_snaps[idx])) {
+                fprintf(stderr, "couldn't restore fixture '%s'\n", fixture);
+                end_game_in(tg);
+                status = 1;
+                break;
+            }
+            // the snapshot brings its own randomizer state, which would deal
+            //  the same pieces every time this fixture comes around
+            tg_seed_rng(tg, fuzz_rand(&rng));
+            tg_set_randomizer(tg, fuzz_rand(&rng) % 2 ? TG_RANDOM_7BAG : TG_RANDOM_UNIFORM);
+        }
+        else {
+            tg_set_randomizer(tg, fuzz_rand(&rng) % 2 ? TG_RANDOM_7BAG : TG_RANDOM_UNIFORM);
+            fuzz_garbage_board(tg, &rng);
+            create_rand_piece(tg);
+        }
+
+        const char *failure = check_board(tg);
+        if (failure == NULL && !tg->game_over)
+            failure = check_piece(tg);
+        // the board and score only change when a piece locks, so this is 
+        //  only taken again after each lock instead of every tick
+        fuzz_lock_state before = lock_state(tg);
+
+        while (failure == NULL && ticks < max_ticks) {
+            enum player_move move = fuzz_move(&rng);
+            // a hard drop on a piece gravity is about to lock would lock
+            //  two pieces in one tick; keep it to one so each lock is checked
+            TetrisPiece below = tg->active_piece;
+            below.loc.row++;
+            if (move == T_HARDDROP && (!tg->active_piece.falling || !test_piece_position(&tg->board, below)))
+                move = T_NONE;
+
+            uint32_t board_gen = tg->board_gen;
+            bool running = tg_tick(tg, move);
+            ticks++;
+
+            if (tg->board_gen != board_gen) {
+                locks++;
+                lines += (before.cells + NUM_CELLS_IN_TETROMINO - count_cells(&tg->board)) / TETRIS_COLS;
+                failure = check_board(tg);
+                if (failure == NULL)
+                    failure = check_lock(tg, &before);
+                before = lock_state(tg);
+            }
+            if (failure == NULL && !tg->game_over)
+                failure = check_piece(tg);
+            if (!running)
+                break;
+        }
+        if (failure != NULL) {
+            report_failure(tg, failure, seed, games, ticks, fixture);
+            status = 1;
+        }
+
+        end_game_in(tg);
+        games++;
+    }
+    free(game_buf);
+    free(fixture_snaps);
+    if (status != 0)
+        return status;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("seed=%llu games=%llu ticks=%llu locks=%llu lines=%llu\n", (unsigned long long) seed, \
+        (unsigned long long) games, (unsigned long long) ticks, (unsigned long long) locks, \
+        (unsigned long long) lines);
+    printf("%.3f s, %.2f M ticks/s, no invariant violations\n", elapsed, ticks / elapsed / 1e6);
+    return 0;
+}
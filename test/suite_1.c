@@ -6,8 +6,19 @@
 
 #include <time.h>   // for testing timing
 #include <unistd.h> // for sleep()
+#include <pthread.h>
 
 #include "tetris.h"
+#include "tetris_placement.h"
+#include "tetris_ttable.h"
+#include "tetris_pool.h"
+#include "tetris_replay.h"
+#include "tetris_snapshot.h"
+#include "tetris_rewind.h"
+#include "tetris_log.h"
+#include "tetris_input.h"
+#include "tetris_frame.h"
+#include "ai_tetris.h"
 #include "tetris_test_helpers.h"
 
 TetrisGame *tg;
@@ -397,6 +408,1027 @@ void test_checkSpawnNewPiece(void) {
 }
 
 
+/**
+ * Test that the occupancy bitboard stays in sync with the color plane
+ * through piece placement and row clearing
+*/
+void test_boardOccupancy(void) {
+    TetrisPiece tp;
+    int test_case = 1;
+
+    // empty board only has the sentinel walls, floor and ceiling
+    for (int i = 0; i < TETRIS_ROWS; i++) {
+        TEST_ASSERT_EQUAL_UINT32(TETRIS_EMPTY_ROW_MASK, TETRIS_ROW_MASK(&tg->board, i));
+    }
+    TEST_ASSERT_EQUAL_UINT32(TETRIS_FULL_ROW_MASK, TETRIS_ROW_MASK(&tg->board, -1));
+    TEST_ASSERT_EQUAL_UINT32(TETRIS_FULL_ROW_MASK, TETRIS_ROW_MASK(&tg->board, TETRIS_ROWS));
+    TEST_ASSERT_FALSE(test_piece_position(&tg->board, create_tetris_piece(I_PIECE, 5, -1, 0)));
+    TEST_ASSERT_FALSE(test_piece_position(&tg->board, create_tetris_piece(I_PIECE, 5, TETRIS_COLS - 3, 0)));
+    TEST_ASSERT_FALSE(test_piece_position(&tg->board, create_tetris_piece(I_PIECE, TETRIS_ROWS - 3, 0, 1)));
+    TEST_ASSERT_FALSE(test_piece_position(&tg->board, create_tetris_piece(T_PIECE, 0, 0, 1)));
+    TEST_ASSERT_TRUE(test_piece_position(&tg->board, create_tetris_piece(I_PIECE, TETRIS_ROWS - 4, 0, 1)));
+
+    // generated rows show up in the masks
+    tp = create_tetris_piece(SQ_PIECE, 14, 1, 0);
+    setup_moveCheck(tg, 3, tp, &test_case);
+    for (int i = TETRIS_ROWS - 3; i < TETRIS_ROWS; i++) {
+        TEST_ASSERT_NOT_EQUAL_INT(TETRIS_EMPTY_ROW_MASK, TETRIS_ROW_MASK(&tg->board, i));
+    }
+
+    // square piece at rows 14-15, cols 1-2 lands and is stamped into the masks
+    tg->active_piece.falling = false;
+    TEST_ASSERT_TRUE(check_and_spawn_new_piece(tg));
+    const uint32_t sq_mask = TETRIS_EMPTY_ROW_MASK | TETRIS_COL_BIT(1) | TETRIS_COL_BIT(2);
+    TEST_ASSERT_EQUAL_UINT32(sq_mask, TETRIS_ROW_MASK(&tg->board, 14));
+    TEST_ASSERT_EQUAL_UINT32(sq_mask, TETRIS_ROW_MASK(&tg->board, 15));
+
+    // fill two rows and clear them, masks shift down with the color plane
+    fill_board_rectangle(&tg->board, 20, 0, 21, TETRIS_COLS, 1);
+    TEST_ASSERT_EQUAL_UINT32(TETRIS_FULL_ROW_MASK, TETRIS_ROW_MASK(&tg->board, 20));
+    TEST_ASSERT_TRUE(check_filled_row(tg, 21));
+    clear_rows(tg, 20, 2);
+    TEST_ASSERT_EQUAL_UINT32(sq_mask, TETRIS_ROW_MASK(&tg->board, 16));
+    TEST_ASSERT_EQUAL_UINT32(sq_mask, TETRIS_ROW_MASK(&tg->board, 17));
+    TEST_ASSERT_EQUAL_UINT32(TETRIS_EMPTY_ROW_MASK, TETRIS_ROW_MASK(&tg->board, 14));
+    TEST_ASSERT_EQUAL_UINT32(TETRIS_EMPTY_ROW_MASK, TETRIS_ROW_MASK(&tg->board, 15));
+
+    // every mask matches a rebuild from the color plane
+    TetrisBoard rebuilt = tg->board;
+    rebuild_board_occupancy(&rebuilt);
+    TEST_ASSERT_EQUAL_MEMORY(rebuilt.occupancy, tg->board.occupancy, sizeof(rebuilt.occupancy));
+}
+
+
+static void assert_board_metrics_equal(const TetrisBoard *expected, const TetrisBoard *actual) {
+    TEST_ASSERT_EQUAL_MEMORY(expected->col_occupancy, actual->col_occupancy, sizeof(expected->col_occupancy));
+    TEST_ASSERT_EQUAL_MEMORY(expected->col_height, actual->col_height, sizeof(expected->col_height));
+    TEST_ASSERT_EQUAL_MEMORY(expected->col_holes, actual->col_holes, sizeof(expected->col_holes));
+    TEST_ASSERT_EQUAL_UINT16(expected->holes, actual->holes);
+    TEST_ASSERT_EQUAL_UINT16(expected->bumpiness, actual->bumpiness);
+    TEST_ASSERT_EQUAL_UINT16(expected->well_depth, actual->well_depth);
+    TEST_ASSERT_TRUE(expected->hash == actual->hash);
+}
+
+/**
+ * Test column heights, holes, bumpiness, and wells as pieces lock 
+ * and rows clear, against hand counts and a full rebuild
+*/
+void test_boardMetrics(void) {
+    TetrisBoard rebuilt;
+
+    // empty board
+    for (int i = 0; i < TETRIS_COLS; i++) {
+        TEST_ASSERT_EQUAL_UINT8(0, tg->board.col_height[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT16(0, tg->board.holes);
+    TEST_ASSERT_EQUAL_UINT16(0, tg->board.bumpiness);
+    TEST_ASSERT_EQUAL_UINT16(0, tg->board.well_depth);
+
+    // vertical I piece against the left wall, 4 tall in col 0
+    tg->active_piece = create_tetris_piece(I_PIECE, TETRIS_ROWS - 4, 0, 1);
+    TEST_ASSERT_TRUE(test_piece_position(&tg->board, tg->active_piece));
+    tg->active_piece.falling = false;
+    TEST_ASSERT_TRUE(check_and_spawn_new_piece(tg));
+    TEST_ASSERT_EQUAL_UINT8(4, tg->board.col_height[0]);
+    TEST_ASSERT_EQUAL_UINT16(4, tg->board.bumpiness);
+    TEST_ASSERT_EQUAL_UINT16(0, tg->board.holes);
+
+    // square on top of cols 1-2 leaving a 2 high gap under it; cols 1 and 2 
+    //  are 4 tall with 2 holes each
+    tg->active_piece = create_tetris_piece(SQ_PIECE, TETRIS_ROWS - 4, 1, 0);
+    tg->active_piece.falling = false;
+    TEST_ASSERT_TRUE(check_and_spawn_new_piece(tg));
+    TEST_ASSERT_EQUAL_UINT8(4, tg->board.col_height[1]);
+    TEST_ASSERT_EQUAL_UINT8(4, tg->board.col_height[2]);
+    TEST_ASSERT_EQUAL_UINT8(2, tg->board.col_holes[1]);
+    TEST_ASSERT_EQUAL_UINT16(4, tg->board.holes);
+    // cols 0-2 are 4 tall, step down to 0 at col 3
+    TEST_ASSERT_EQUAL_UINT16(4, tg->board.bumpiness);
+
+    rebuilt = tg->board;
+    rebuild_board_occupancy(&rebuilt);
+    assert_board_metrics_equal(&rebuilt, &tg->board);
+
+    // fill the bottom row except col 3, leaving a well between the stack 
+    //  and col 4
+    fill_board_rectangle(&tg->board, TETRIS_ROWS - 1, 1, TETRIS_ROWS - 1, TETRIS_COLS, 1);
+    tg->board.board[TETRIS_ROWS - 1][3] = BG_COLOR;
+    rebuild_board_occupancy(&tg->board);
+    TEST_ASSERT_EQUAL_UINT8(0, tg->board.col_height[3]);
+    TEST_ASSERT_EQUAL_UINT8(1, tg->board.col_holes[1]);
+    TEST_ASSERT_EQUAL_UINT16(1, tg->board.well_depth);
+
+    // vertical I drops into col 3 and clears the bottom row; everything 
+    //  shifts down one and the metrics still match a rebuild
+    tg->active_piece = create_tetris_piece(I_PIECE, TETRIS_ROWS - 4, 3, 1);
+    tg->active_piece.falling = false;
+    TEST_ASSERT_TRUE(check_and_spawn_new_piece(tg));
+    TEST_ASSERT_EQUAL_UINT8(3, tg->board.col_height[0]);
+    TEST_ASSERT_EQUAL_UINT8(3, tg->board.col_height[3]);
+    TEST_ASSERT_EQUAL_UINT8(1, tg->board.col_holes[1]);
+    TEST_ASSERT_EQUAL_UINT8(0, tg->board.col_height[4]);
+
+    rebuilt = tg->board;
+    rebuild_board_occupancy(&rebuilt);
+    assert_board_metrics_equal(&rebuilt, &tg->board);
+}
+
+
+/**
+ * Test landing row query against stepping the piece down one row at a 
+ * time, and that T_HARDDROP locks the piece there
+*/
+void test_hardDrop(void) {
+    // empty board: horizontal I lands on the floor
+    tg->active_piece = create_tetris_piece(I_PIECE, 1, TETRIS_COLS / 2 - 2, 0);
+    TEST_ASSERT_EQUAL_INT8(TETRIS_ROWS - 1, tg_landing_row(tg));
+
+    // every piece and orientation over a stack with a gap in every row
+    setup_N_lines_board(&tg->board, 8);
+    tg_board_changed(tg);
+    for (int ptype = 0; ptype < NUM_TETROMINOS; ptype++) {
+        for (int orientation = 0; orientation < NUM_ORIENTATIONS; orientation++) {
+            for (int col = 0; col < TETRIS_COLS; col++) {
+                tg->active_piece = create_tetris_piece(ptype, 2, col, orientation);
+                if (!test_piece_position(&tg->board, tg->active_piece))
+                    continue;
+
+                int8_t landing_row = tg_landing_row(tg);
+                while (check_valid_move(tg, T_DOWN))
+                    tg->active_piece.loc.row += 1;
+                TEST_ASSERT_EQUAL_INT8(tg->active_piece.loc.row, landing_row);
+            }
+        }
+    }
+
+    // hard drop locks the piece at the landing row and spawns the next one
+    tg_set_clock(tg, TG_CLOCK_VIRTUAL);
+    tg->last_gravity_tick_usec = tg_clock_now_usec(tg);
+    tg->active_piece = create_tetris_piece(SQ_PIECE, 2, 0, 0);
+    int8_t landing_row = tg_landing_row(tg);
+    TEST_ASSERT_TRUE(tg_tick(tg, T_HARDDROP));
+    TEST_ASSERT_EQUAL_INT8(SQ_PIECE, tg->board.board[landing_row][0]);
+    TEST_ASSERT_EQUAL_INT8(SQ_PIECE, tg->board.board[landing_row + 1][1]);
+    TEST_ASSERT_EQUAL_INT8(1, tg->active_piece.loc.row);
+    TEST_ASSERT_TRUE(tg->active_piece.falling);
+}
+
+
+/**
+ * Replay the path to every placement in `pl` through tg_tick from the
+ * spawn location, and check the piece ends up resting there
+*/
+static void check_placement_paths(TetrisPlacementList *pl) {
+    static enum player_move moves[TETRIS_PLACEMENT_STATES];
+    TetrisBoard board = tg->board;
+
+    // virtual clock that never advances, so gravity doesn't interfere
+    tg_set_clock(tg, TG_CLOCK_VIRTUAL);
+    tg->last_gravity_tick_usec = tg_clock_now_usec(tg);
+
+    for (uint16_t i = 0; i < pl->num_placements; i++) {
+        TetrisPiece expected = placement_to_piece(pl, i);
+        uint16_t path_len = get_placement_path(pl, i, moves, TETRIS_PLACEMENT_STATES);
+        TEST_ASSERT_EQUAL_UINT16(pl->placements[i].path_len, path_len);
+
+        tg->board = board;
+        tg->active_piece = pl->start;
+        for (uint16_t m = 0; m < path_len; m++) {
+            tg_tick(tg, moves[m]);
+        }
+        TEST_ASSERT_EQUAL_INT8(expected.loc.row, tg->active_piece.loc.row);
+        TEST_ASSERT_EQUAL_INT8(expected.loc.col, tg->active_piece.loc.col);
+        TEST_ASSERT_EQUAL_UINT8(expected.orientation, tg->active_piece.orientation);
+        TEST_ASSERT_FALSE(check_valid_move(tg, T_DOWN));
+    }
+}
+
+/**
+ * Test the reachable placement search on an empty board, where the
+ * counts are known, and under an overhang only reachable by sliding
+*/
+void test_findPlacements(void) {
+    static TetrisPlacementList pl;
+
+    // one placement per column for each distinct orientation width
+    TEST_ASSERT_EQUAL_UINT16(TETRIS_COLS - 1, find_placements(&tg->board, SQ_PIECE, &pl));
+    check_placement_paths(&pl);
+    TEST_ASSERT_EQUAL_UINT16(TETRIS_COLS + TETRIS_COLS - 3, find_placements(&tg->board, I_PIECE, &pl));
+    check_placement_paths(&pl);
+    TEST_ASSERT_EQUAL_UINT16(4 * TETRIS_COLS - 6, find_placements(&tg->board, T_PIECE, &pl));
+    check_placement_paths(&pl);
+
+    // roof over the left side of the bottom 2 rows; a square can only get 
+    //  into the corner under it by dropping on the right and sliding left
+    fill_board_rectangle(&tg->board, TETRIS_ROWS - 3, 0, TETRIS_ROWS - 3, TETRIS_COLS - 4, 1);
+    find_placements(&tg->board, SQ_PIECE, &pl);
+    bool found_corner = false;
+    for (uint16_t i = 0; i < pl.num_placements; i++) {
+        if (pl.placements[i].loc.row == TETRIS_ROWS - 2 && pl.placements[i].loc.col == 0)
+            found_corner = true;
+    }
+    TEST_ASSERT_TRUE_MESSAGE(found_corner, "placement under overhang not found");
+    check_placement_paths(&pl);
+
+    // blocked spawn has nowhere to go
+    fill_board_rectangle(&tg->board, 0, 0, 3, TETRIS_COLS, 1);
+    TEST_ASSERT_EQUAL_UINT16(0, find_placements(&tg->board, SQ_PIECE, &pl));
+}
+
+
+/**
+ * Test gravity timing with the virtual and frame clocks, which
+ * must be deterministic and independent of wall time
+*/
+void test_virtualClockGravity(void) {
+    tg->active_piece = create_tetris_piece(T_PIECE, 1, TETRIS_COLS / 2, 0);
+
+    // frame clock: 10ms frames, gravity fires on the 20th tick
+    tg_set_frame_clock(tg, 10000);
+    for (int i = 0; i < 19; i++) {
+        TEST_ASSERT_TRUE(tg_tick(tg, T_NONE));
+    }
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, tg->active_piece.loc.row, "gravity fired early on frame clock");
+    TEST_ASSERT_TRUE(tg_tick(tg, T_NONE));
+    TEST_ASSERT_EQUAL_INT_MESSAGE(2, tg->active_piece.loc.row, "gravity didn't fire on frame clock");
+    TEST_ASSERT_EQUAL_INT(200000, tg_clock_now_usec(tg));
+
+    // virtual clock only moves when told to
+    tg_set_clock(tg, TG_CLOCK_VIRTUAL);
+    TEST_ASSERT_FALSE(check_do_piece_gravity(tg));
+    tg_advance_clock(tg, GRAVITY_TICK_RATE_INITIAL - 1);
+    TEST_ASSERT_FALSE(check_do_piece_gravity(tg));
+    tg_advance_clock(tg, 1);
+    TEST_ASSERT_TRUE(check_do_piece_gravity(tg));
+    TEST_ASSERT_EQUAL_INT(3, tg->active_piece.loc.row);
+
+    // switching back to the frame clock keeps the period set above, and a 
+    //  new game's frame clock starts with the default one
+    tg_set_clock(tg, TG_CLOCK_FRAME);
+    tg_tick(tg, T_NONE);
+    TEST_ASSERT_EQUAL_INT(10000, tg_clock_now_usec(tg));
+    TetrisGame *fresh = create_game_seeded(1);
+    create_rand_piece(fresh);
+    tg_set_clock(fresh, TG_CLOCK_FRAME);
+    tg_tick(fresh, T_NONE);
+    TEST_ASSERT_EQUAL_INT(TG_FRAME_USEC_DEFAULT, tg_clock_now_usec(fresh));
+    end_game(fresh);
+}
+
+
+/**
+ * Test that games with the same seed get the same pieces, and 
+ * that 7-bag mode deals every piece once per bag
+*/
+void test_seededRandomizer(void) {
+    TetrisGame *tg_a = create_game_seeded(1234);
+    TetrisGame *tg_b = create_game_seeded(1234);
+
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_EQUAL_INT_MESSAGE(create_rand_piece(tg_a).ptype, create_rand_piece(tg_b).ptype, \
+            "same seed gave different piece sequence");
+    }
+
+    tg_set_randomizer(tg_a, TG_RANDOM_7BAG);
+    for (int bag = 0; bag < 10; bag++) {
+        bool seen[NUM_TETROMINOS] = {false};
+        for (int i = 0; i < NUM_TETROMINOS; i++) {
+            enum piece_type ptype = create_rand_piece(tg_a).ptype;
+            TEST_ASSERT_TRUE(ptype < NUM_TETROMINOS);
+            TEST_ASSERT_FALSE_MESSAGE(seen[ptype], "piece dealt twice from one bag");
+            seen[ptype] = true;
+        }
+    }
+
+    // reseeding replays the sequence
+    tg_seed_rng(tg_a, 99);
+    tg_seed_rng(tg_b, 99);
+    tg_set_randomizer(tg_b, TG_RANDOM_7BAG);
+    for (int i = 0; i < 50; i++) {
+        TEST_ASSERT_EQUAL_INT(tg_next_ptype(tg_a), tg_next_ptype(tg_b));
+    }
+
+    end_game(tg_a);
+    end_game(tg_b);
+}
+
+
+/**
+ * Test that clones are independent of their source, and that applying a 
+ * placement scores like a landing piece without touching the rng or clock
+*/
+void test_cloneApplyPlacement(void) {
+    // bottom row full except cols 0-3, so a flat I clears it
+    fill_board_rectangle(&tg->board, TETRIS_ROWS - 1, 4, TETRIS_ROWS - 1, TETRIS_COLS, 1);
+    tg->level = 2;
+
+    TetrisGame *children = malloc(4 * sizeof(TetrisGame));
+    for (int i = 0; i < 4; i++)
+        tg_clone_into(&children[i], tg);
+    TEST_ASSERT_FALSE(children[0].active_board_valid);
+    TEST_ASSERT_TRUE(children[3].board.hash == tg->board.hash);
+
+    uint64_t clock_before = tg_clock_now_usec(&children[1]);
+    TetrisApplyResult res = tg_apply_placement(&children[1], \
+        create_tetris_piece(I_PIECE, TETRIS_ROWS - 1, 0, 0));
+    TEST_ASSERT_EQUAL_UINT8(1, res.lines_cleared);
+    TEST_ASSERT_EQUAL_UINT32(2 * points_per_line_cleared[1], res.score_gained);
+    TEST_ASSERT_EQUAL_UINT32(tg->score + res.score_gained, children[1].score);
+    TEST_ASSERT_TRUE(res.valid);
+    TEST_ASSERT_FALSE(res.game_over);
+    TEST_ASSERT_TRUE(children[1].board.hash == 0);
+    TEST_ASSERT_EQUAL_UINT16(0, children[1].board.holes);
+    TEST_ASSERT_TRUE(tg_clock_now_usec(&children[1]) >= clock_before);
+
+    // placements off the board, over the stack, or of no piece at all are 
+    //  refused without touching the game
+    const TetrisPiece bad[] = {
+        create_tetris_piece(I_PIECE, TETRIS_ROWS - 1, 4, 0),
+        create_tetris_piece(I_PIECE, TETRIS_ROWS, 0, 0),
+        create_tetris_piece(I_PIECE, -40, 0, 1),
+        create_tetris_piece(SQ_PIECE, 0, TETRIS_COLS - 1, 0),
+        create_tetris_piece(T_PIECE, 5, -3, 0),
+        {.ptype = NUM_TETROMINOS, .loc = {5, 5}, .orientation = 0},
+        {.ptype = T_PIECE, .loc = {5, 5}, .orientation = NUM_ORIENTATIONS},
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        res = tg_apply_placement(&children[3], bad[i]);
+        TEST_ASSERT_FALSE(res.valid);
+        TEST_ASSERT_EQUAL_UINT8(0, res.lines_cleared);
+        TEST_ASSERT_EQUAL_UINT32(0, res.score_gained);
+        TEST_ASSERT_TRUE(children[3].board.hash == tg->board.hash);
+        TEST_ASSERT_EQUAL_UINT32(tg->score, children[3].score);
+    }
+
+    // the source and the other clones didn't change, and still deal the same pieces
+    TEST_ASSERT_TRUE(tg->board.hash == children[0].board.hash);
+    TEST_ASSERT_TRUE(tg->board.hash != 0);
+    TEST_ASSERT_EQUAL_UINT8(1, tg->board.col_height[TETRIS_COLS - 1]);
+    for (int i = 0; i < 10; i++) {
+        enum piece_type ptype = tg_next_ptype(tg);
+        TEST_ASSERT_EQUAL_INT(ptype, tg_next_ptype(&children[1]));
+        TEST_ASSERT_EQUAL_INT(ptype, tg_next_ptype(&children[2]));
+    }
+
+    // a clone renders its own active board, with its own piece on it
+    children[2].active_piece = create_tetris_piece(SQ_PIECE, 5, 5, 0);
+    render_active_board_incremental(&children[2]);
+    TEST_ASSERT_TRUE(children[2].active_board_valid);
+    TEST_ASSERT_EQUAL_MEMORY(tg->board.board[TETRIS_ROWS - 1], \
+        children[2].active_board.board[TETRIS_ROWS - 1], sizeof(tg->board.board[0]));
+    TEST_ASSERT_TRUE(memcmp(tg->board.board, children[2].active_board.board, sizeof(tg->board.board)) != 0);
+    TEST_ASSERT_TRUE(memcmp(tg->board.board, children[2].board.board, sizeof(tg->board.board)) == 0);
+
+    free(children);
+}
+
+
+/**
+ * Test pool slot reuse and alignment, and that games made in caller 
+ * memory match heap games with the same seed
+*/
+void test_gamePool(void) {
+    static _Alignas(TG_POOL_ALIGN) uint8_t storage[TG_POOL_STORAGE_SIZE(3)];
+    TetrisGamePool pool;
+    tg_pool_init(&pool, storage, sizeof(storage));
+    TEST_ASSERT_EQUAL_UINT32(3, pool.capacity);
+
+    TetrisGame *games[3];
+    for (int i = 0; i < 3; i++) {
+        games[i] = tg_pool_acquire(&pool, 100 + i);
+        TEST_ASSERT_NOT_NULL(games[i]);
+        TEST_ASSERT_EQUAL_UINT32(0, (uintptr_t) games[i] % TG_POOL_ALIGN);
+        TEST_ASSERT_EQUAL_UINT32(1, games[i]->level);
+    }
+    TEST_ASSERT_NULL(tg_pool_acquire(&pool, 0));
+    TEST_ASSERT_EQUAL_UINT32(3, pool.in_use);
+
+    // a released slot is the next one handed out, as a fresh game
+    lock_piece(games[1], create_tetris_piece(SQ_PIECE, TETRIS_ROWS - 2, 0, 0));
+    tg_pool_release(&pool, games[1]);
+    TetrisGame *reused = tg_pool_acquire(&pool, 5);
+    TEST_ASSERT_TRUE(reused == games[1]);
+    TEST_ASSERT_TRUE(reused->board.hash == 0);
+    for (int i = 0; i < 3; i++)
+        tg_pool_release(&pool, games[i]);
+    TEST_ASSERT_EQUAL_UINT32(0, pool.in_use);
+
+    TetrisGamePool *heap_pool = tg_pool_create(16);
+    TEST_ASSERT_NOT_NULL(heap_pool);
+    TetrisGame *a = tg_pool_acquire(heap_pool, 77);
+    TetrisGame *b = tg_pool_acquire(heap_pool, 77);
+    TEST_ASSERT_EQUAL_UINT32(TG_POOL_SLOT_SIZE, (uint8_t*) b - (uint8_t*) a);
+    TEST_ASSERT_EQUAL_UINT32(0, (uintptr_t) a % TG_POOL_ALIGN);
+
+    _Alignas(TetrisGame) uint8_t buf[sizeof(TetrisGame)];
+    TetrisGame *in_buf = create_game_seeded_in(buf, 77);
+    for (int i = 0; i < 20; i++) {
+        enum piece_type ptype = tg_next_ptype(a);
+        TEST_ASSERT_EQUAL_INT(ptype, tg_next_ptype(b));
+        TEST_ASSERT_EQUAL_INT(ptype, tg_next_ptype(in_buf));
+    }
+    end_game_in(in_buf);
+    tg_pool_destroy(heap_pool);
+}
+
+
+/**
+ * Test that a recorded game replays bit-exact through a file, and that 
+ * replays which end differently or are cut short are caught
+*/
+void test_replayRoundTrip(void) {
+    TetrisReplay rec;
+    TetrisGame *game = replay_start(&rec, 2024, TG_RANDOM_7BAG, 10000);
+
+    // mash moves every few ticks with a fixed xorshift, so the game clears 
+    //  some rows and eventually tops out
+    const enum player_move moves[] = {T_UP, T_DOWN, T_LEFT, T_RIGHT, T_HARDDROP};
+    uint32_t x = 12345;
+    uint64_t ticks = 0;
+    while (ticks < 200000) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        enum player_move move = (x % 4 == 0) ? moves[(x >> 8) % 5] : T_NONE;
+        ticks++;
+        if (!replay_tick(&rec, game, move))
+            break;
+    }
+    TEST_ASSERT_TRUE(replay_finish(&rec, game));
+    TEST_ASSERT_TRUE(rec.ticks == ticks);
+    // about a byte per move, with 1 in 4 ticks a move
+    TEST_ASSERT_TRUE(rec.len < ticks / 2);
+
+    TEST_ASSERT_TRUE(replay_save(&rec, "test_replay.tgr"));
+    TetrisReplay loaded;
+    TEST_ASSERT_TRUE(replay_load(&loaded, "test_replay.tgr"));
+    remove("test_replay.tgr");
+    TEST_ASSERT_TRUE(loaded.seed == rec.seed);
+    TEST_ASSERT_TRUE(rec.len == loaded.len);
+
+    TetrisReplayResult res = replay_run(&loaded);
+    TEST_ASSERT_EQUAL_INT(REPLAY_OK, res.status);
+    TEST_ASSERT_TRUE(res.ticks == ticks);
+    TEST_ASSERT_EQUAL_UINT32(game->score, res.score);
+    TEST_ASSERT_TRUE(game->board.hash == res.hash);
+
+    // recorded final board doesn't match
+    loaded.data[loaded.len - 1] ^= 1;
+    TEST_ASSERT_EQUAL_INT(REPLAY_MISMATCH, replay_run(&loaded).status);
+    loaded.data[loaded.len - 1] ^= 1;
+    loaded.len -= 3;
+    TEST_ASSERT_EQUAL_INT(REPLAY_CORRUPT, replay_run(&loaded).status);
+    loaded.len += 3;
+
+    // idle ticks after the game topped out
+    TEST_ASSERT_TRUE(game->game_over);
+    uint8_t *end_marker = &loaded.data[loaded.len - 17];
+    TEST_ASSERT_TRUE(end_marker[-1] < 0x80 && *end_marker < 0x80 - (1 << TG_REPLAY_MOVE_BITS));
+    *end_marker += 1 << TG_REPLAY_MOVE_BITS;
+    TEST_ASSERT_EQUAL_INT(REPLAY_CORRUPT, replay_run(&loaded).status);
+    *end_marker -= 1 << TG_REPLAY_MOVE_BITS;
+    TEST_ASSERT_EQUAL_INT(REPLAY_OK, replay_run(&loaded).status);
+
+    // a 2^50 tick idle run is refused up front instead of played
+    uint8_t huge[] = {0x83, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x10, 0x00};
+    TetrisReplay bad = {.seed = 1, .frame_usec = 10000, .data = huge, .len = sizeof(huge), \
+        .finished = true};
+    res = replay_run(&bad);
+    TEST_ASSERT_EQUAL_INT(REPLAY_CORRUPT, res.status);
+    TEST_ASSERT_TRUE(res.ticks == 0);
+
+    replay_free(&loaded);
+    replay_free(&rec);
+    end_game(game);
+}
+
+
+/**
+ * Test that a game restored from an INI save survives a trip through a 
+ * binary snapshot file, including the rng, and that bad snapshots are refused
+*/
+void test_binarySnapshot(void) {
+    #ifdef TETRIS_UNIT_TEST_CI
+    char* gamestate_file = "../test/files/gamestate-J-lined-up-dbl-clear.ini";
+    #else
+    char* gamestate_file = "./test/files/gamestate-J-lined-up-dbl-clear.ini";
+    #endif
+    TEST_ASSERT_TRUE(restore_game_state(tg, gamestate_file, stdout));
+    tg_set_randomizer(tg, TG_RANDOM_7BAG);
+    tg_next_ptype(tg);
+
+    TEST_ASSERT_TRUE(tg_snapshot_write_file(tg, "test_snapshot.tgs"));
+    TetrisGame *loaded = create_game_seeded(1);
+    TEST_ASSERT_TRUE(tg_snapshot_read_file(loaded, "test_snapshot.tgs"));
+    remove("test_snapshot.tgs");
+
+    TEST_ASSERT_EQUAL_MEMORY(tg->board.board, loaded->board.board, sizeof(tg->board.board));
+    TEST_ASSERT_EQUAL_MEMORY(tg->active_board.board, loaded->active_board.board, \
+        sizeof(tg->active_board.board));
+    assert_board_metrics_equal(&tg->board, &loaded->board);
+    TEST_ASSERT_EQUAL_UINT8(tg->board.highest_occupied_cell, loaded->board.highest_occupied_cell);
+    TEST_ASSERT_EQUAL_UINT32(tg->score, loaded->score);
+    TEST_ASSERT_EQUAL_UINT32(tg->gravity_tick_rate_usec, loaded->gravity_tick_rate_usec);
+    TEST_ASSERT_TRUE(tg->last_gravity_tick_usec == loaded->last_gravity_tick_usec);
+    TEST_ASSERT_EQUAL_INT(tg->active_piece.ptype, loaded->active_piece.ptype);
+    TEST_ASSERT_EQUAL_INT8(tg->active_piece.loc.row, loaded->active_piece.loc.row);
+    TEST_ASSERT_EQUAL_INT8(tg->active_piece.loc.col, loaded->active_piece.loc.col);
+    for (int i = 0; i < 20; i++)
+        TEST_ASSERT_EQUAL_INT(tg_next_ptype(tg), tg_next_ptype(loaded));
+
+    TetrisSnapshot snap;
+    tg_snapshot_save(loaded, &snap);
+    TEST_ASSERT_TRUE(tg_snapshot_valid(&snap));
+    snap.version++;
+    TEST_ASSERT_FALSE(tg_snapshot_load(loaded, &snap));
+    snap.version--;
+    snap.endian = __builtin_bswap32(snap.endian);
+    TEST_ASSERT_FALSE(tg_snapshot_load(loaded, &snap));
+
+    end_game(loaded);
+}
+
+
+static uint64_t snapshot_test_clock(void *ctx) {
+    return *(uint64_t *) ctx;
+}
+
+/**
+ * Test that snapshots with any out of range field are rejected, that a 
+ * fresh game's snapshot is valid whatever memory it was created in, and 
+ * that a custom clock snapshot loaded into a game without one goes on a 
+ * virtual clock instead of a NULL callback
+*/
+void test_snapshotTamper(void) {
+    TetrisSnapshot good, snap;
+
+    // a game made in garbage memory, before its first 7-bag draw
+    static TetrisGame dirty;
+    memset(&dirty, 0x7f, sizeof(dirty));
+    create_game_seeded_in(&dirty, 3);
+    create_rand_piece(&dirty);
+    tg_snapshot_save(&dirty, &snap);
+    TEST_ASSERT_TRUE(tg_snapshot_valid(&snap));
+    TEST_ASSERT_TRUE(tg_snapshot_load(&dirty, &snap));
+    end_game_in(&dirty);
+
+    fill_board_rectangle(&tg->board, TETRIS_ROWS - 2, 0, TETRIS_ROWS - 1, TETRIS_COLS - 1, 2);
+    tg_set_randomizer(tg, TG_RANDOM_7BAG);
+    create_rand_piece(tg);
+    tg_snapshot_save(tg, &good);
+    TEST_ASSERT_TRUE(tg_snapshot_valid(&good));
+
+    // pieces already dealt from the bag are never read again
+    snap = good;
+    snap.rng_bag[0] = NUM_TETROMINOS;
+    TEST_ASSERT_TRUE(tg_snapshot_valid(&snap));
+
+    #define TAMPER(field, value) \
+        do { snap = good; snap.field = (value); TEST_ASSERT_FALSE(tg_snapshot_valid(&snap)); } while (0)
+    TAMPER(piece_ptype, NUM_TETROMINOS);
+    TAMPER(piece_orientation, NUM_ORIENTATIONS);
+    TAMPER(rng_mode, TG_RANDOM_7BAG + 1);
+    TAMPER(clock_source, TG_CLOCK_CUSTOM + 1);
+    TAMPER(rng_bag_idx, NUM_TETROMINOS + 1);
+    TAMPER(rng_bag[3], NUM_TETROMINOS);
+    TAMPER(piece_row, -1);
+    TAMPER(piece_row, TETRIS_ROWS);
+    TAMPER(piece_row, INT8_MIN);
+    TAMPER(piece_col, -1);
+    TAMPER(piece_col, TETRIS_COLS);
+    TAMPER(piece_col, INT8_MAX);
+    TAMPER(board_highest_occupied_cell, TETRIS_ROWS);
+    TAMPER(active_board_highest_occupied_cell, 0xff);
+    TAMPER(board[TETRIS_ROWS - 1][0], NUM_TETROMINOS);
+    TAMPER(board[0][TETRIS_COLS - 1], BG_COLOR - 1);
+    TAMPER(active_board[5][5], INT8_MAX);
+    TAMPER(active_board[TETRIS_ROWS - 1][TETRIS_COLS - 1], INT8_MIN);
+    #undef TAMPER
+
+    TetrisGame *loaded = create_game_seeded(1);
+    snap = good;
+    snap.board[0][0] = NUM_TETROMINOS;
+    TEST_ASSERT_FALSE(tg_snapshot_load(loaded, &snap));
+    TEST_ASSERT_EQUAL_INT8(BG_COLOR, loaded->board.board[0][0]);
+
+    // custom clock snapshot into a game on the wall clock
+    uint64_t now = 5000000;
+    tg_set_custom_clock(tg, snapshot_test_clock, &now);
+    tg->clock.virtual_usec = 1234567;
+    tg_snapshot_save(tg, &snap);
+    TEST_ASSERT_TRUE(tg_snapshot_load(loaded, &snap));
+    TEST_ASSERT_EQUAL_INT(TG_CLOCK_VIRTUAL, loaded->clock.source);
+    TEST_ASSERT_TRUE(tg_clock_now_usec(loaded) == 1234567);
+    tg_tick(loaded, T_NONE);
+
+    // and into a game that has a custom clock of its own, which it keeps
+    uint64_t other = 42;
+    tg_set_custom_clock(loaded, snapshot_test_clock, &other);
+    TEST_ASSERT_TRUE(tg_snapshot_load(loaded, &snap));
+    TEST_ASSERT_EQUAL_INT(TG_CLOCK_CUSTOM, loaded->clock.source);
+    TEST_ASSERT_TRUE(tg_clock_now_usec(loaded) == 42);
+
+    end_game(loaded);
+}
+
+/**
+ * Test that rewinding restores the board colors, score, active piece and 
+ * upcoming pieces from earlier spawns, and that the ring only keeps the 
+ * newest entries
+*/
+void test_rewind(void) {
+    static TetrisPlacementList pl;
+    fill_board_rectangle(&tg->board, TETRIS_ROWS - 2, 3, TETRIS_ROWS - 1, TETRIS_COLS, 2);
+    tg_set_randomizer(tg, TG_RANDOM_7BAG);
+    create_rand_piece(tg);
+    TEST_ASSERT_FALSE(tg_rewind(tg, 0));
+    TEST_ASSERT_TRUE(tg_enable_rewind(tg, 8));
+    TEST_ASSERT_EQUAL_UINT16(0, tg_rewind_available(tg));
+
+    // play 12 pieces, keeping a copy of the game at every spawn
+    TetrisGame *history = malloc(12 * sizeof(TetrisGame));
+    for (int i = 0; i < 12; i++) {
+        tg_clone_into(&history[i], tg);
+        uint16_t n = find_placements(&tg->board, tg->active_piece.ptype, &pl);
+        TEST_ASSERT_TRUE(n > 0);
+        tg_apply_placement(tg, placement_to_piece(&pl, (i * 7) % n));
+        create_rand_piece(tg);
+    }
+    TEST_ASSERT_EQUAL_UINT16(7, tg_rewind_available(tg));
+    TEST_ASSERT_FALSE(tg_rewind(tg, 8));
+
+    int expected[] = {9, 5};
+    uint16_t steps[] = {3, 4};
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_TRUE(tg_rewind(tg, steps[i]));
+        TetrisGame *want = &history[expected[i]];
+        TEST_ASSERT_EQUAL_MEMORY(want->board.board, tg->board.board, sizeof(tg->board.board));
+        assert_board_metrics_equal(&want->board, &tg->board);
+        TEST_ASSERT_EQUAL_UINT8(want->board.highest_occupied_cell, tg->board.highest_occupied_cell);
+        TEST_ASSERT_EQUAL_UINT32(want->score, tg->score);
+        TEST_ASSERT_EQUAL_UINT8(want->lines_cleared_since_last_level, tg->lines_cleared_since_last_level);
+        TEST_ASSERT_EQUAL_INT(want->active_piece.ptype, tg->active_piece.ptype);
+        TEST_ASSERT_EQUAL_INT8(want->active_piece.loc.row, tg->active_piece.loc.row);
+
+        enum piece_type want_next[10], got_next[10];
+        tg_peek_ptypes(want, want_next, 10);
+        tg_peek_ptypes(tg, got_next, 10);
+        TEST_ASSERT_EQUAL_MEMORY(want_next, got_next, sizeof(want_next));
+    }
+    TEST_ASSERT_EQUAL_UINT16(0, tg_rewind_available(tg));
+
+    // k = 0 puts the falling piece back at its spawn
+    tg->active_piece.loc.row += 3;
+    TEST_ASSERT_TRUE(tg_rewind(tg, 0));
+    TEST_ASSERT_EQUAL_INT8(TETRIS_SPAWN_ROW, tg->active_piece.loc.row);
+
+    tg_disable_rewind(tg);
+    TEST_ASSERT_FALSE(tg_rewind(tg, 0));
+    free(history);
+}
+
+
+/**
+ * Test tick instrumentation counts each phase of tg_tick(), or reports 
+ * that it's compiled out
+*/
+void test_tickStats(void) {
+    TetrisStats stats;
+    tg_set_frame_clock(tg, 10000);
+    // bottom row full except cols 0-3, so a flat I dropped there clears it
+    fill_board_rectangle(&tg->board, TETRIS_ROWS - 1, 4, TETRIS_ROWS - 1, TETRIS_COLS, 1);
+    tg->active_piece = create_tetris_piece(I_PIECE, TETRIS_SPAWN_ROW, 0, 0);
+    for (int i = 0; i < 5; i++)
+        tg_tick(tg, T_NONE);
+    tg_tick(tg, T_HARDDROP);
+    tg_tick(tg, T_LEFT);
+
+    #ifdef TETRIS_STATS
+    TEST_ASSERT_TRUE(tg_get_stats(tg, &stats));
+    TEST_ASSERT_TRUE(stats.ticks == 7);
+    TEST_ASSERT_TRUE(stats.calls[TG_STAT_GRAVITY] == 7);
+    TEST_ASSERT_TRUE(stats.calls[TG_STAT_RENDER] == 7);
+    TEST_ASSERT_TRUE(stats.calls[TG_STAT_MOVE] == 7);
+    TEST_ASSERT_TRUE(stats.calls[TG_STAT_SPAWN_LOCK] == 1);
+    TEST_ASSERT_TRUE(stats.calls[TG_STAT_CLEAR] == 1);
+    tg_dump_stats(tg, stdout);
+    tg_reset_stats(tg);
+    TEST_ASSERT_TRUE(tg_get_stats(tg, &stats));
+    TEST_ASSERT_TRUE(stats.ticks == 0);
+    #else
+    TEST_ASSERT_FALSE(tg_get_stats(tg, &stats));
+    TEST_ASSERT_TRUE(stats.ticks == 0 && stats.calls[TG_STAT_GRAVITY] == 0);
+    #endif
+}
+
+
+/**
+ * Test the event log ring drops records instead of overwriting when full, 
+ * drains them in order, and formats them as the old DEBUG_T text
+*/
+void test_eventLog(void) {
+    TetrisLog *log = calloc(1, sizeof(TetrisLog));
+    for (int32_t i = 0; i < TG_LOG_CAPACITY + 3; i++)
+        tg_log_push(log, 1000 + i, TG_EV_CHECK_ROW, (const int32_t[TG_LOG_MAX_ARGS]) {i});
+    TEST_ASSERT_EQUAL_UINT32(3, atomic_load(&log->dropped));
+
+    FILE *f = tmpfile();
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL_UINT32(TG_LOG_CAPACITY, tg_log_drain(log, f, false));
+    TEST_ASSERT_EQUAL_UINT32(0, tg_log_drain(log, f, false));
+
+    // the ring wraps once it's been drained
+    tg_log_push(log, 5, TG_EV_CLEAR_ROWS, (const int32_t[TG_LOG_MAX_ARGS]) {2, 31, 30});
+    TEST_ASSERT_EQUAL_UINT32(1, tg_log_drain(log, f, false));
+
+    rewind(f);
+    TetrisLogRecord rec;
+    for (int32_t i = 0; i < TG_LOG_CAPACITY; i++) {
+        TEST_ASSERT_TRUE(fread(&rec, sizeof(rec), 1, f) == 1);
+        TEST_ASSERT_TRUE(rec.event == TG_EV_CHECK_ROW && rec.args[0] == i && rec.usec == 1000u + i);
+    }
+    TEST_ASSERT_TRUE(fread(&rec, sizeof(rec), 1, f) == 1);
+    fclose(f);
+
+    char text[128] = {0};
+    f = fmemopen(text, sizeof(text) - 1, "w");
+    tg_log_format(&rec, f);
+    fclose(f);
+    TEST_ASSERT_TRUE(strcmp(text, "smallest value in array {31, 30, } is 30!\n"
+        "clearing 2 rows with top_row=30\n") == 0);
+
+    free(log);
+}
+
+
+/**
+ * Test that board hashes only depend on which cells are filled, and 
+ * transposition table stores, probes, and replacement
+*/
+void test_zobristTTable(void) {
+    TEST_ASSERT_TRUE(tg->board.hash == 0);
+
+    // the same two pieces locked in either order, in different colors, 
+    //  hash the same
+    TetrisGame *other = create_game_seeded(7);
+    TetrisPiece a = create_tetris_piece(I_PIECE, TETRIS_ROWS - 4, 0, 1);
+    TetrisPiece b = create_tetris_piece(SQ_PIECE, TETRIS_ROWS - 2, 4, 0);
+    lock_piece(tg, a);
+    lock_piece(tg, b);
+    lock_piece(other, b);
+    lock_piece(other, a);
+    TEST_ASSERT_TRUE(tg->board.hash != 0);
+    TEST_ASSERT_TRUE(tg->board.hash == other->board.hash);
+    TEST_ASSERT_TRUE(tg->board.hash == tg_board_hash(&tg->board));
+
+    fill_board_rectangle(&other->board, TETRIS_ROWS - 2, 4, TETRIS_ROWS - 1, 6, T_CELL_COLOR);
+    rebuild_board_occupancy(&other->board);
+    TEST_ASSERT_TRUE(tg->board.hash == other->board.hash);
+    end_game(other);
+
+    TetrisTTable *tt = tt_create(10);
+    TEST_ASSERT_NOT_NULL(tt);
+    uint64_t data = 0;
+    uint64_t key = tt_state_key(tg->board.hash, T_PIECE, 0);
+    TEST_ASSERT_FALSE(tt_probe(tt, key, &data));
+    tt_store(tt, key, 1234);
+    TEST_ASSERT_TRUE(tt_probe(tt, key, &data));
+    TEST_ASSERT_TRUE(data == 1234);
+
+    // orientation and piece are part of the key
+    TEST_ASSERT_FALSE(tt_probe(tt, tt_state_key(tg->board.hash, T_PIECE, 1), &data));
+    TEST_ASSERT_FALSE(tt_probe(tt, tt_state_key(tg->board.hash, L_PIECE, 0), &data));
+
+    // a key landing in the same slot replaces the old entry
+    uint64_t clash = key + (tt->mask + 1);
+    tt_store(tt, clash, 99);
+    TEST_ASSERT_FALSE(tt_probe(tt, key, &data));
+    TEST_ASSERT_TRUE(tt_probe(tt, clash, &data));
+    TEST_ASSERT_TRUE(data == 99);
+
+    tt_clear(tt);
+    TEST_ASSERT_FALSE(tt_probe(tt, clash, &data));
+    tt_destroy(tt);
+}
+
+
+/**
+ * Test the input queue, and that tg_tick_moves() applies a burst of moves
+ * in one tick and shows them on active_board right away
+*/
+void test_tickMoves(void) {
+    static TetrisInputQueue q;
+    tg_input_init(&q);
+    TEST_ASSERT_TRUE(tg_input_push(&q, 10, T_LEFT));
+    TEST_ASSERT_TRUE(tg_input_push(&q, 20, T_LEFT));
+    TEST_ASSERT_TRUE(tg_input_push(&q, 30, T_RIGHT));
+    enum player_move moves[TG_INPUT_CAPACITY];
+    TEST_ASSERT_EQUAL_UINT32(2, tg_input_drain(&q, moves, TG_INPUT_CAPACITY, 20));
+    TEST_ASSERT_EQUAL_UINT32(1, tg_input_pending(&q));
+    TEST_ASSERT_EQUAL_UINT32(1, tg_input_drain(&q, &moves[2], 1, UINT64_MAX));
+    TEST_ASSERT_TRUE(moves[0] == T_LEFT && moves[1] == T_LEFT && moves[2] == T_RIGHT);
+    for (int i = 0; i < TG_INPUT_CAPACITY; i++)
+        TEST_ASSERT_TRUE(tg_input_push(&q, i, T_DOWN));
+    TEST_ASSERT_FALSE(tg_input_push(&q, 0, T_DOWN));
+    TEST_ASSERT_EQUAL_UINT32(1, atomic_load(&q.dropped));
+    TEST_ASSERT_EQUAL_UINT32(TG_INPUT_CAPACITY, tg_input_drain(&q, moves, TG_INPUT_CAPACITY, UINT64_MAX));
+
+    tg_set_frame_clock(tg, 10000);
+    create_rand_piece(tg);
+    TEST_ASSERT_TRUE(tg_tick_moves(tg, (const enum player_move[]) {T_LEFT, T_LEFT, T_RIGHT}, 3));
+    TetrisPiece tp = tg->active_piece;
+    TEST_ASSERT_EQUAL_INT8(TETRIS_SPAWN_COL - 1, tp.loc.col);
+    for (int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
+        tetris_location c = TETROMINOS[tp.ptype][tp.orientation][i];
+        TEST_ASSERT_EQUAL_INT8(tp.ptype, tg->active_board.board[tp.loc.row + c.row][tp.loc.col + c.col]);
+    }
+
+    // moves after a hard drop go to the next piece, in the same tick
+    uint32_t board_gen = tg->board_gen;
+    TEST_ASSERT_TRUE(tg_tick_moves(tg, (const enum player_move[]) {T_HARDDROP, T_LEFT}, 2));
+    TEST_ASSERT_TRUE(tg->board_gen != board_gen);
+    TEST_ASSERT_EQUAL_INT8(TETRIS_SPAWN_ROW, tg->active_piece.loc.row);
+    TEST_ASSERT_EQUAL_INT8(TETRIS_SPAWN_COL - 1, tg->active_piece.loc.col);
+    TEST_ASSERT_TRUE(tg_tick_moves(tg, NULL, 0));
+}
+
+#define FRAME_TEST_COUNT 200000
+
+// publishes frames whose every cell and score hold the frame number
+static void *frame_producer(void *arg) {
+    TetrisFrameBuffer *fb = arg;
+    for (uint32_t i = 1; i <= FRAME_TEST_COUNT; i++) {
+        TetrisFrame *f = tg_frames_back(fb);
+        memset(f->cells, (int8_t) i, sizeof(f->cells));
+        f->score = i;
+        tg_frames_publish(fb);
+    }
+    return NULL;
+}
+
+/**
+ * Test that the frame triple buffer always hands the reader the newest
+ * frame, and never one the writer is still filling
+*/
+void test_frameTripleBuffer(void) {
+    static TetrisFrameBuffer fb;
+    tg_frames_init(&fb);
+    const TetrisFrame *f;
+    TEST_ASSERT_FALSE(tg_frames_latest(&fb, &f));
+
+    // frames the reader didn't take in time are skipped
+    create_rand_piece(tg);
+    tg_tick(tg, T_NONE);
+    for (int i = 0; i < 3; i++) {
+        tg->score = i;
+        tg_frames_publish_game(&fb, tg);
+    }
+    TEST_ASSERT_TRUE(tg_frames_latest(&fb, &f));
+    TEST_ASSERT_EQUAL_UINT32(2, f->score);
+    TEST_ASSERT_TRUE(f->seq == 2);
+    TEST_ASSERT_EQUAL_MEMORY(tg->active_board.board, f->cells, sizeof(f->cells));
+    TEST_ASSERT_EQUAL_UINT32(tg->active_board_gen, f->active_board_gen);
+    TEST_ASSERT_FALSE(tg_frames_latest(&fb, &f));
+    TEST_ASSERT_TRUE(f != tg_frames_back(&fb));
+
+    tg_frames_init(&fb);
+    pthread_t producer;
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&producer, NULL, frame_producer, &fb));
+    uint32_t last = 0, taken = 0;
+    while (last < FRAME_TEST_COUNT) {
+        if (!tg_frames_latest(&fb, &f))
+            continue;
+        TEST_ASSERT_TRUE(f->score > last);
+        for (int row = 0; row < TETRIS_ROWS; row++) {
+            for (int col = 0; col < TETRIS_COLS; col++)
+                TEST_ASSERT_EQUAL_INT8((int8_t) f->score, f->cells[row][col]);
+        }
+        last = f->score;
+        taken++;
+    }
+    pthread_join(producer, NULL);
+    TEST_ASSERT_TRUE(taken > 0);
+}
+
+/**
+ * Regressions from fuzz_tetris: a lock that fills rows with a partial row
+ * between them clears both, and a piece that spawns onto the stack ends
+ * the game
+*/
+void test_splitClearAndSpawnOverlap(void) {
+    const int R = TETRIS_ROWS;
+    fill_board_rectangle(&tg->board, R - 4, 1, R - 1, TETRIS_COLS, 2);
+    tg->board.board[R - 2][5] = BG_COLOR;
+    tg->board.board[R - 4][7] = BG_COLOR;
+    rebuild_board_occupancy(&tg->board);
+    tg->board.highest_occupied_cell = R - 4;
+
+    // vertical I down column 0 fills rows R-1 and R-3 only
+    TetrisApplyResult res = tg_apply_placement(tg, create_tetris_piece(I_PIECE, R - 4, 0, 1));
+    TEST_ASSERT_EQUAL_UINT8(2, res.lines_cleared);
+    TEST_ASSERT_EQUAL_UINT32(tg->level * 300, res.score_gained);
+    for (int col = 0; col < TETRIS_COLS; col++) {
+        TEST_ASSERT_EQUAL_INT8(col == 5 ? BG_COLOR : (col == 0 ? I_PIECE : 2), tg->board.board[R - 1][col]);
+        TEST_ASSERT_EQUAL_INT8(col == 7 ? BG_COLOR : (col == 0 ? I_PIECE : 2), tg->board.board[R - 2][col]);
+    }
+    TEST_ASSERT_FALSE(check_for_occ_cells_in_row(tg, R - 3));
+    TEST_ASSERT_EQUAL_UINT8(R - 2, tg->board.highest_occupied_cell);
+    check_no_filled_rows(tg);
+    check_occ_cells_above_highest(tg);
+
+    // stack up to the row under the spawn row, with column 0 left open so
+    //  nothing clears. Every piece but I reaches into it when it spawns
+    fill_board_rectangle(&tg->board, TETRIS_SPAWN_ROW + 1, 1, R - 1, TETRIS_COLS, 2);
+    tg->board.highest_occupied_cell = TETRIS_SPAWN_ROW + 1;
+    tg_set_frame_clock(tg, 10000);
+    enum piece_type next;
+    tg_peek_ptypes(tg, &next, 1);
+    create_rand_piece(tg);
+    TEST_ASSERT_EQUAL_INT(next, tg->active_piece.ptype);
+    TEST_ASSERT_TRUE(tg->game_over == (next != I_PIECE));
+    TEST_ASSERT_TRUE(check_game_over(tg) == (next != I_PIECE));
+    if (next != I_PIECE)
+        TEST_ASSERT_FALSE(tg_tick(tg, T_NONE));
+}
+
+/**
+ * Test that tg_peek_ptypes() sees the pieces that actually spawn next, and
+ * that the autoplayer clears lines and survives a few hundred pieces
+*/
+void test_aiPlayer(void) {
+    TetrisGame *game = create_game_seeded(42);
+    tg_set_frame_clock(game, 10000);
+    create_rand_piece(game);
+
+    enum piece_type upcoming[4];
+    tg_peek_ptypes(game, upcoming, 4);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_INT_MESSAGE(upcoming[i], create_rand_piece(game).ptype, \
+            "peeked piece doesn't match the spawned one");
+    }
+
+    ai_config cfg = ai_default_config();
+    cfg.num_threads = 2;
+    ai_player *ai = ai_create(&cfg);
+    TEST_ASSERT_NOT_NULL(ai);
+
+    uint32_t pieces = 0, last_gen = game->board_gen;
+    while (pieces < 300) {
+        TEST_ASSERT_TRUE_MESSAGE(tg_tick(game, ai_next_move(ai, game)), "autoplayer topped out");
+        if (game->board_gen != last_gen) {
+            TEST_ASSERT_TRUE_MESSAGE(game->board.hash == tg_board_hash(&game->board), \
+                "incremental board hash drifted");
+            pieces++;
+            last_gen = game->board_gen;
+        }
+    }
+    TEST_ASSERT_TRUE(game->score > 0);
+    TEST_ASSERT_TRUE(game->board.highest_occupied_cell > TETRIS_ROWS / 2);
+
+    ai_destroy(ai);
+    end_game(game);
+}
+
+
+/**
+ * Test that incremental rendering matches a full render, and only
+ * bumps active_board_gen when something changed
+*/
+void test_incrementalRender(void) {
+    TetrisPiece tp;
+    int test_case = 1;
+    TetrisBoard full;
+
+    tp = create_tetris_piece(L_PIECE, 10, 4, 0);
+    setup_moveCheck(tg, 6, tp, &test_case);
+    uint32_t gen = tg->active_board_gen;
+
+    // nothing moved, nothing to draw
+    TEST_ASSERT_FALSE(render_active_board_incremental(tg));
+    TEST_ASSERT_EQUAL_UINT32(gen, tg->active_board_gen);
+
+    // move and rotate piece, incremental result has to match a full render
+    tg->active_piece.loc.col += 1;
+    tg->active_piece.orientation = 1;
+    TEST_ASSERT_TRUE(render_active_board_incremental(tg));
+    TEST_ASSERT_EQUAL_UINT32(gen + 1, tg->active_board_gen);
+    TetrisBoard incremental = tg->active_board;
+    full = render_active_board(tg);
+    TEST_ASSERT_EQUAL_MEMORY(&full, &incremental, sizeof(TetrisBoard));
+
+    // drop piece onto the stack (bottom cells at row 25) and lock it
+    //  into the board, board change forces a full redraw
+    move_piece_down(tg, 14);
+    reset_game_gravity_time(tg);
+    TEST_ASSERT_FALSE(check_do_piece_gravity(tg));
+    TEST_ASSERT_TRUE(check_and_spawn_new_piece(tg));
+    TEST_ASSERT_TRUE(render_active_board_incremental(tg));
+    incremental = tg->active_board;
+    full = render_active_board(tg);
+    TEST_ASSERT_EQUAL_MEMORY(&full, &incremental, sizeof(TetrisBoard));
+}
+
+
 void test_getElapsedUs(void) {
     struct timeval before, after;
     const uint32_t ms_in_1s = 1000;
@@ -472,6 +1504,26 @@ int main(void)
     // test fails when using tools like valgrind
     // RUN_TEST(test_getElapsedUs);
     RUN_TEST(test_arr_helpers);
+    RUN_TEST(test_boardOccupancy);
+    RUN_TEST(test_boardMetrics);
+    RUN_TEST(test_hardDrop);
+    RUN_TEST(test_findPlacements);
+    RUN_TEST(test_virtualClockGravity);
+    RUN_TEST(test_seededRandomizer);
+    RUN_TEST(test_incrementalRender);
+    RUN_TEST(test_zobristTTable);
+    RUN_TEST(test_cloneApplyPlacement);
+    RUN_TEST(test_gamePool);
+    RUN_TEST(test_replayRoundTrip);
+    RUN_TEST(test_binarySnapshot);
+    RUN_TEST(test_snapshotTamper);
+    RUN_TEST(test_rewind);
+    RUN_TEST(test_tickStats);
+    RUN_TEST(test_eventLog);
+    RUN_TEST(test_tickMoves);
+    RUN_TEST(test_frameTripleBuffer);
+    RUN_TEST(test_splitClearAndSpawnOverlap);
+    RUN_TEST(test_aiPlayer);
     RUN_TEST(test_clearRowsDumpedGame_1);
     RUN_TEST(test_clearRowsDumpedGame_2);
     
@@ -13,14 +13,16 @@
 void add_incomplete_line_to_board(TetrisBoard *tb, uint8_t row) {
     // uint8_t highest_cell  = tg->board->highest_occupied_cell;
     
-    // index of col to skip (so won't be a complete row)
-    uint8_t skipped_col_index = rand() % TETRIS_COLS + 1;    
+    // index of col to skip (so won't be a complete row). edge columns are 
+    //  always filled, the move checking tests rely on them as a floor
+    uint8_t skipped_col_index = rand() % (TETRIS_COLS - 3) + 1;
     // printf("adding incomplete line to row %d, col %d\n", row, skipped_col_index);
     for (int i = 0; i < TETRIS_COLS; i++) {
         if (i != skipped_col_index) {
             tb->board[row][i] = 1;
         }
     }
+    rebuild_board_occupancy(tb);
 }
 
 /**
@@ -54,6 +56,7 @@ void fill_board_rectangle(TetrisBoard *tb, int8_t tL_row, int8_t tL_col, \
             tb->board[r][c] = fill_value;
         }
     }
+    rebuild_board_occupancy(tb);
     #ifdef DEBUG_T
     fprintf(gamelog, "filled cells from TL [%d,%d] to BR [%d,%d]\n", \
         tL_row, tL_col, bR_row, bR_col);
@@ -188,9 +191,7 @@ void check_no_filled_rows(TetrisGame *tg) {
 void reset_game_gravity_time(TetrisGame *tg) {
     // bypass time check in game logic
     tg->gravity_tick_rate_usec = 0; 
-    gettimeofday(&tg->last_gravity_tick_usec, NULL);
-    tg->last_gravity_tick_usec.tv_sec -= 1;
-    tg->last_gravity_tick_usec.tv_usec -= 100;
+    tg->last_gravity_tick_usec = tg_clock_now_usec(tg) - 1000100;
 }
 
 
@@ -6,21 +6,65 @@
  * Mainly, this concerns time interval handling inside check_do_piece_gravity()
  * and similar game tick related functions. 
  * 
- * I used `struct timeval` in this implementation, but this may not be available
+ * By default the game reads `gettimeofday()`, but this may not be available
  * on your microcontroller platform. All the math is done in microseconds
- * (because that's what timeval returns) as `long long`, so substitute your 
- * platform's RTC functionality and it should work as desired. 
+ * as `uint64_t`, so either pick another TG_CLOCK_* source or pass your 
+ * platform's RTC functionality to tg_set_custom_clock() and it should 
+ * work as desired. Headless simulations can use the virtual/frame clocks
+ * to run faster than real time. 
  * 
  * @author Jacob Bokor, jacobbokor.com
  * @date 03/2024
 */
 
 #include "tetris.h"
+#include "tetris_rewind.h"
+#include "tetris_log.h"
 
 #ifdef DEBUG_T
 // DEBUG_T is tetris game logic debug flag
 // linker didn't like it being included normally
 FILE *gamelog;
+// number of live games sharing gamelog, so it's only closed by the last one. 
+//  Games are created and ended from several threads (sim workers), so the 
+//  count and the fopen/fclose it gates are guarded by gamelog_lock
+static int gamelog_users = 0;
+static pthread_mutex_t gamelog_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// log a game logic event to tg's binary log, see tetris_log.h. Pass at least
+//  one arg (0 if the event has none); missing args are 0
+#define TG_LOG(tg, event, ...) do { \
+    if ((tg)->log) \
+        tg_log_push((tg)->log, tg_clock_now_usec(tg), (event), \
+            (const int32_t[TG_LOG_MAX_ARGS]) {__VA_ARGS__}); \
+} while (0)
+#else
+#define TG_LOG(tg, event, ...)
+#endif
+
+#ifdef TETRIS_STATS
+static inline uint64_t stats_now_nsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// time a phase of tg_tick() into tg->stats. Time charged to phases nested 
+//  inside it is taken back out, then the whole phase is charged to its parent
+#define TG_STATS_BEGIN(tg, mark) \
+    uint64_t mark##_nested = (tg)->stats.nested_nsec; \
+    (tg)->stats.nested_nsec = 0; \
+    uint64_t mark##_start = stats_now_nsec()
+
+#define TG_STATS_END(tg, mark, phase) do { \
+    uint64_t elapsed_ = stats_now_nsec() - mark##_start; \
+    (tg)->stats.calls[phase]++; \
+    (tg)->stats.nsec[phase] += elapsed_ - (tg)->stats.nested_nsec; \
+    (tg)->stats.nested_nsec = mark##_nested + elapsed_; \
+} while (0)
+#else
+#define TG_STATS_BEGIN(tg, mark)
+#define TG_STATS_END(tg, mark, phase)
 #endif
 
 
@@ -36,18 +80,200 @@ TetrisBoard init_board(void) {
             b.board[i][j] = -1;
         }
     }
+    rebuild_board_occupancy(&b);
 
     b.highest_occupied_cell = TETRIS_ROWS - 1;
     return b;
 }
 
+/**
+ * Height difference between column `col` and the column to its right
+*/
+static inline uint16_t col_bumpiness(const TetrisBoard *tb, int col) {
+    int diff = tb->col_height[col] - tb->col_height[col + 1];
+    return diff < 0 ? -diff : diff;
+}
+
+/**
+ * How far column `col` sits below the lower of its two neighbors, 
+ * treating the walls as full height. 0 if it isn't a well
+*/
+static inline uint16_t col_well_depth(const TetrisBoard *tb, int col) {
+    uint8_t left = (col == 0) ? TETRIS_ROWS : tb->col_height[col - 1];
+    uint8_t right = (col == TETRIS_COLS - 1) ? TETRIS_ROWS : tb->col_height[col + 1];
+    uint8_t lowest = left < right ? left : right;
+    return lowest > tb->col_height[col] ? lowest - tb->col_height[col] : 0;
+}
+
+/**
+ * Recompute height and holes of columns `first_col` to `last_col` from 
+ * col_occupancy, and patch the board-wide holes, bumpiness, and well 
+ * counters by swapping out only the terms those columns take part in
+*/
+static void update_column_metrics(TetrisBoard *tb, int first_col, int last_col) {
+    // bumpiness terms are pairs (col, col+1), wells depend on both neighbors
+    int bump_first = first_col > 0 ? first_col - 1 : 0;
+    int bump_last = last_col < TETRIS_COLS - 1 ? last_col : TETRIS_COLS - 2;
+    int well_first = bump_first;
+    int well_last = last_col < TETRIS_COLS - 1 ? last_col + 1 : TETRIS_COLS - 1;
+
+    for (int col = bump_first; col <= bump_last; col++)
+        tb->bumpiness -= col_bumpiness(tb, col);
+    for (int col = well_first; col <= well_last; col++)
+        tb->well_depth -= col_well_depth(tb, col);
+
+    for (int col = first_col; col <= last_col; col++) {
+        uint32_t mask = tb->col_occupancy[col];
+        // lowest set bit is the top filled cell of the column
+        uint8_t height = mask ? TETRIS_ROWS - __builtin_ctz(mask) : 0;
+        uint8_t holes = height - __builtin_popcount(mask);
+        tb->holes += holes - tb->col_holes[col];
+        tb->col_height[col] = height;
+        tb->col_holes[col] = holes;
+    }
+
+    for (int col = bump_first; col <= bump_last; col++)
+        tb->bumpiness += col_bumpiness(tb, col);
+    for (int col = well_first; col <= well_last; col++)
+        tb->well_depth += col_well_depth(tb, col);
+}
+
+/**
+ * Recompute bumpiness and well_depth from scratch out of col_height
+*/
+static void compute_neighbor_metrics(TetrisBoard *tb) {
+    tb->bumpiness = 0;
+    tb->well_depth = 0;
+    for (int col = 0; col < TETRIS_COLS; col++) {
+        if (col < TETRIS_COLS - 1)
+            tb->bumpiness += col_bumpiness(tb, col);
+        tb->well_depth += col_well_depth(tb, col);
+    }
+}
+
+/**
+ * Recompute every column's height and holes and the board-wide counters 
+ * from col_occupancy in one pass, for rebuilding a board where patching 
+ * term by term would cost double
+*/
+static void compute_column_metrics(TetrisBoard *tb) {
+    tb->holes = 0;
+    for (int col = 0; col < TETRIS_COLS; col++) {
+        uint32_t mask = tb->col_occupancy[col];
+        uint8_t height = mask ? TETRIS_ROWS - __builtin_ctz(mask) : 0;
+        tb->col_height[col] = height;
+        tb->col_holes[col] = height - __builtin_popcount(mask);
+        tb->holes += tb->col_holes[col];
+    }
+    compute_neighbor_metrics(tb);
+}
+
+/**
+ * Zobrist key of board row `row` holding `cells` (bit `col` set for each 
+ * occupied column). The board hash XORs one key per row rather than one 
+ * per cell, so moving or changing a row costs a single key no matter how 
+ * full it is. Keys are a hash of the row and its cells rather than a table 
+ * filled at startup, so there's nothing to initialize and every game and 
+ * thread agrees on them. Empty rows key to 0
+*/
+uint64_t tg_zobrist_key(int row, uint32_t cells) {
+    if (cells == 0)
+        return 0;
+    uint64_t z = ((uint64_t) row << 32 | cells) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Zobrist key of occupancy mask `row_mask`, as if it were row `row`
+*/
+static inline uint64_t zobrist_row_hash(int row, uint32_t row_mask) {
+    return tg_zobrist_key(row, (row_mask >> TETRIS_BOARD_PAD) & ((1u << TETRIS_COLS) - 1));
+}
+
+/**
+ * Zobrist hash of the board computed from scratch. tb->hash is kept equal 
+ * to this as the game runs
+*/
+uint64_t tg_board_hash(const TetrisBoard *tb) {
+    uint64_t h = 0;
+    for (int i = 0; i < TETRIS_ROWS; i++)
+        h ^= zobrist_row_hash(i, TETRIS_ROW_MASK(tb, i));
+    return h;
+}
+
+/**
+ * Recompute the occupancy bitboards, column metrics and hash from the color plane. 
+ * Only needed when tb->board has been written to directly (restoring 
+ * a save, unit test setup); game logic keeps them in sync itself
+*/
+void rebuild_board_occupancy(TetrisBoard *tb) {
+    // sentinel floor and ceiling rows are completely occupied
+    for (int i = 0; i < TETRIS_BOARD_PAD; i++) {
+        TETRIS_ROW_MASK(tb, -1 - i) = TETRIS_FULL_ROW_MASK;
+        TETRIS_ROW_MASK(tb, TETRIS_ROWS + i) = TETRIS_FULL_ROW_MASK;
+    }
+
+    for (int i = 0; i < TETRIS_ROWS; i++) {
+        uint32_t row_mask = TETRIS_EMPTY_ROW_MASK;
+        for (int j = 0; j < TETRIS_COLS; j++) {
+            if (tb->board[i][j] != BG_COLOR)
+                row_mask |= TETRIS_COL_BIT(j);
+        }
+        TETRIS_ROW_MASK(tb, i) = row_mask;
+    }
+
+    // column masks, then the metrics from scratch so the incremental 
+    //  updates have a consistent base to patch
+    memset(tb->col_occupancy, 0, sizeof(tb->col_occupancy));
+    for (int j = 0; j < TETRIS_COLS; j++) {
+        for (int i = 0; i < TETRIS_ROWS; i++) {
+            if (tb->board[i][j] != BG_COLOR)
+                tb->col_occupancy[j] |= 1u << i;
+        }
+    }
+    compute_column_metrics(tb);
+    tb->hash = tg_board_hash(tb);
+}
+
 
 /**
- * Create a new tetris game struct
+ * Create a new tetris game struct. Seeds the game's rng from rand(), 
+ * so srand() still controls the piece sequence of games created this way
  * @returns TetrisGame* struct ptr
 */
 TetrisGame* create_game(void) {
-    TetrisGame *tg = malloc(sizeof(TetrisGame));
+    return create_game_seeded((uint64_t) rand());
+}
+
+/**
+ * Create a new tetris game struct whose piece sequence is fully 
+ * determined by `seed`
+ * @returns TetrisGame* struct ptr
+*/
+TetrisGame* create_game_seeded(uint64_t seed) {
+    return create_game_seeded_in(malloc(sizeof(TetrisGame)), seed);
+}
+
+/**
+ * Create a new game in memory the caller owns (static storage, a pool 
+ * slot, etc.), seeded from rand() like create_game(). `buf` must hold 
+ * sizeof(TetrisGame) bytes aligned for TetrisGame. Finish with 
+ * end_game_in() instead of end_game()
+ * @returns `buf` as a TetrisGame*
+*/
+TetrisGame* create_game_in(void *buf) {
+    return create_game_seeded_in(buf, (uint64_t) rand());
+}
+
+/**
+ * create_game_in() with a fixed seed, see create_game_seeded()
+*/
+TetrisGame* create_game_seeded_in(void *buf, uint64_t seed) {
+    assert(buf != NULL && (uintptr_t) buf % _Alignof(TetrisGame) == 0 && \
+        "game buffer missing or misaligned");
+    TetrisGame *tg = buf;
 
     tg->board = init_board();
     tg->active_board = init_board();
@@ -56,17 +282,37 @@ TetrisGame* create_game(void) {
     tg->score = 0;
     tg->gravity_tick_rate_usec = GRAVITY_TICK_RATE_INITIAL;
     tg->lines_cleared_since_last_level = 0;
+    // a placeholder at the spawn point until create_rand_piece() deals the 
+    //  first one, so ticking or rendering before that never reads garbage. 
+    //  Set by hand so it doesn't draw from the rng
+    tg->active_piece = (TetrisPiece) {.ptype = S_PIECE, .orientation = 0, \
+        .loc = {.row = TETRIS_SPAWN_ROW, .col = TETRIS_SPAWN_COL}, .falling = true};
+    tg->clock.frame_usec = TG_FRAME_USEC_DEFAULT;
+    tg_set_clock(tg, TG_CLOCK_WALL);
+    tg->rng.mode = TG_RANDOM_UNIFORM;
+    tg_seed_rng(tg, seed);
+    tg->board_gen = 0;
+    tg->active_board_gen = 0;
+    tg->rendered_board_gen = 0;
+    tg->active_board_valid = false;
+    tg->rewind = NULL;
+    tg_reset_stats(tg);
 
 
     #ifdef DEBUG_T
         #ifndef TETRIS_UNIT_TEST_DEF
         // separate gamelog file to prevent ncurses printing issues
-        gamelog = fopen("game.log", "w+");
+        pthread_mutex_lock(&gamelog_lock);
+        if (gamelog_users++ == 0)
+            gamelog = fopen("game.log", "w+");
+        pthread_mutex_unlock(&gamelog_lock);
         #else
         // for unit testing, assign gamelog to stdout so the output shows up 
         //  in the GH actions console
         gamelog = stdout;
         #endif
+        // game logic events go to the binary log instead of gamelog
+        tg->log = tg_log_open();
     #endif
 
     return tg;
@@ -76,43 +322,94 @@ TetrisGame* create_game(void) {
  * Deallocate tetris game struct
 */
 void end_game(TetrisGame *tg) {
+    end_game_in(tg);
+    free(tg);
+}
+
+/**
+ * Finish a game made with create_game_in(). The memory is left to the 
+ * caller to reuse or free
+*/
+void end_game_in(TetrisGame *tg) {
+    tg_disable_rewind(tg);
     #ifdef DEBUG_T
-    fprintf(gamelog, "Deallocating tetris game\n");
+    TG_LOG(tg, TG_EV_GAME_END, 0);
+    tg_log_close(tg->log);
+    tg->log = NULL;
         #ifndef TETRIS_UNIT_TEST_DEF
-        fclose(gamelog);
+        pthread_mutex_lock(&gamelog_lock);
+        if (--gamelog_users == 0)
+            fclose(gamelog);
+        pthread_mutex_unlock(&gamelog_lock);
         #endif
     #endif
+}
 
+static_assert(offsetof(TetrisGame, board) == 0 && offsetof(TetrisGame, active_piece) == \
+    offsetof(TetrisGame, active_board) + sizeof(TetrisBoard), \
+    "tg_clone_into() expects board, active_board, then everything else");
 
-    free(tg);
+/**
+ * Copy game `src` into `dst`, which can be any TetrisGame-sized memory 
+ * (an array slot, stack variable, etc.), for branching a game during search. 
+ * active_board isn't copied; it's marked stale instead, so the next tick or 
+ * render_active_board_incremental() call redraws it. A custom clock's ctx 
+ * pointer is shared with `src`. The clone starts without rewind history, 
+ * and doesn't log events. 
+ * `dst` is treated as raw memory and nothing it held is released, so it 
+ * must not own rewind history or a log: pass an unused buffer or an earlier 
+ * clone, or end_game_in() a live game before cloning over it
+*/
+void tg_clone_into(TetrisGame *dst, const TetrisGame *src) {
+    dst->board = src->board;
+    memcpy(&dst->active_piece, &src->active_piece, \
+        sizeof(TetrisGame) - offsetof(TetrisGame, active_piece));
+    dst->active_board_valid = false;
+    dst->rewind = NULL;
+    #ifdef DEBUG_T
+    dst->log = NULL;
+    #endif
 }
 
 /**
- * Process a single Tetris game tick.
- * @brief This function is the only one you need to call to use the tetris game - everything
- *  is processed internally. Pass player moves into this function, and then just 
- *  render the tg->active_board array to your desired display format. 
- * @param TetrisGame* tg - pointer to TetrisGame struct
- * @param player_move most recent player move as enum
- * @returns true if game is still going, false when game_over
+ * Everything in a tick before the player's move: advance a frame clock,
+ * run gravity, lock and spawn, and draw active_board
+ * @returns false on game over
 */
-bool tg_tick(TetrisGame *tg, enum player_move move) {
+static bool tg_tick_begin(TetrisGame *tg) {
+    // frame clock: every tick is one frame of game time
+    if (tg->clock.source == TG_CLOCK_FRAME)
+        tg->clock.virtual_usec += tg->clock.frame_usec;
 
+    #ifdef TETRIS_STATS
+    tg->stats.ticks++;
+    #endif
+
+    TG_STATS_BEGIN(tg, gravity);
     check_do_piece_gravity(tg);
+    TG_STATS_END(tg, gravity, TG_STAT_GRAVITY);
     check_and_spawn_new_piece(tg);      // includes row clearing and score updates
-    render_active_board(tg);
+    TG_STATS_BEGIN(tg, render);
+    render_active_board_incremental(tg);
+    TG_STATS_END(tg, render, TG_STAT_RENDER);
     if (check_game_over(tg)) {        // check for game over condition
-        #ifdef DEBUG_T
-            fprintf(gamelog, "game over detected, returning false from tg_tick\n");
-        #endif
+        TG_LOG(tg, TG_EV_GAME_OVER, 0);
         return false;
     }
+    return true;
+}
 
+/**
+ * Apply one player move to the active piece
+*/
+static void tg_apply_move(TetrisGame *tg, enum player_move move) {
     switch (move) {
         case T_NONE:
             break;
 
         case T_UP:
+            TG_LOG(tg, TG_EV_ROTATE, tg->active_piece.orientation, \
+                (tg->active_piece.orientation + 1) % NUM_ORIENTATIONS);
             if(test_piece_rotate(&tg->board, tg->active_piece))
                 tg->active_piece.orientation = (tg->active_piece.orientation + 1) % 4;
             break;
@@ -130,24 +427,323 @@ bool tg_tick(TetrisGame *tg, enum player_move move) {
             if(check_valid_move(tg, move))
                 tg->active_piece.loc.col += 1;
             break;
-        
+
+        case T_HARDDROP:
+            // drop straight to the landing row and lock there now, instead of
+            //  waiting out the gravity ticks on the way down
+            tg->active_piece.loc.row = tg_landing_row(tg);
+            tg->active_piece.falling = false;
+            check_and_spawn_new_piece(tg);
+            break;
+    
         case T_PLAYPAUSE:
             assert(false && "T_PLAYPAUSE should not be passed to tg_tick in current impl");
             break;
-        
+    
         // T_QUIT implemented by driver
 
         default:
             // we should not get here
-            #ifdef DEBUG_T
-            fprintf(gamelog, "tg_tick default case! uhoh  ");
-            fprintf(gamelog, "player_move=%d \n", move);
-            #endif
+            TG_LOG(tg, TG_EV_TICK_BAD_MOVE, move);
             assert(false && "reached default state of tg_tick");
             break;
     }
+}
+
+/**
+ * Process a single Tetris game tick.
+ * @brief This function is the only one you need to call to use the tetris game - everything
+ *  is processed internally. Pass player moves into this function, and then just 
+ *  render the tg->active_board array to your desired display format. 
+ * @param TetrisGame* tg - pointer to TetrisGame struct
+ * @param player_move most recent player move as enum
+ * @returns true if game is still going, false when game_over
+*/
+bool tg_tick(TetrisGame *tg, enum player_move move) {
+    if (!tg_tick_begin(tg))
+        return false;
+
+    TG_STATS_BEGIN(tg, move_phase);
+    tg_apply_move(tg, move);
+    TG_STATS_END(tg, move_phase, TG_STAT_MOVE);
+
+    // a hard drop can spawn the next piece on top of the stack
+    return !tg->game_over;
+}
 
+/**
+ * Process a tick with every move queued since the last one, eg from a
+ * TetrisInputQueue, applied in order. Unlike tg_tick(), active_board is
+ * redrawn after the moves, so the display shows them as soon as this
+ * returns. Moves after one that ends the game are dropped
+ * @param moves player moves, oldest first
+ * @param n number of moves, 0 runs a tick without input
+ * @returns true if game is still going, false when game_over
+*/
+bool tg_tick_moves(TetrisGame *tg, const enum player_move *moves, uint32_t n) {
+    if (!tg_tick_begin(tg))
+        return false;
+    if (n == 0)
+        return true;
+
+    TG_STATS_BEGIN(tg, move_phase);
+    for (uint32_t i = 0; i < n && !tg->game_over; i++)
+        tg_apply_move(tg, moves[i]);
+    TG_STATS_END(tg, move_phase, TG_STAT_MOVE);
+
+    TG_STATS_BEGIN(tg, render);
+    render_active_board_incremental(tg);
+    TG_STATS_END(tg, render, TG_STAT_RENDER);
+    return !tg->game_over;
+}
+
+/**
+ * Copy out the tick instrumentation counters
+ * @returns false, zeroing `out`, if the library wasn't built with TETRIS_STATS
+*/
+bool tg_get_stats(const TetrisGame *tg, TetrisStats *out) {
+    #ifdef TETRIS_STATS
+    *out = tg->stats;
     return true;
+    #else
+    (void) tg;
+    memset(out, 0, sizeof(TetrisStats));
+    return false;
+    #endif
+}
+
+/**
+ * Zero the tick instrumentation counters
+*/
+void tg_reset_stats(TetrisGame *tg) {
+    #ifdef TETRIS_STATS
+    memset(&tg->stats, 0, sizeof(TetrisStats));
+    #else
+    (void) tg;
+    #endif
+}
+
+/**
+ * Print calls, total time, and average time of each tg_tick() phase to `out`
+*/
+void tg_dump_stats(const TetrisGame *tg, FILE *out) {
+    static const char *phase_names[TG_NUM_STAT_PHASES] = \
+        {"gravity", "spawn/lock", "row clear", "render", "move"};
+
+    TetrisStats stats;
+    if (!tg_get_stats(tg, &stats)) {
+        fprintf(out, "tetris stats not compiled in, build with TETRIS_STATS_MACRO=ON\n");
+        return;
+    }
+
+    uint64_t total_nsec = 0;
+    for (int i = 0; i < TG_NUM_STAT_PHASES; i++)
+        total_nsec += stats.nsec[i];
+    fprintf(out, "%llu ticks, %.3f ms in tg_tick phases\n", \
+        (unsigned long long) stats.ticks, total_nsec / 1e6);
+    fprintf(out, "%-12s %12s %12s %10s\n", "phase", "calls", "total ms", "avg ns");
+    for (int i = 0; i < TG_NUM_STAT_PHASES; i++) {
+        fprintf(out, "%-12s %12llu %12.3f %10.0f\n", phase_names[i], \
+            (unsigned long long) stats.calls[i], stats.nsec[i] / 1e6, \
+            stats.calls[i] ? (double) stats.nsec[i] / stats.calls[i] : 0.0);
+    }
+}
+
+
+/**
+ * Select the time source used for gravity. Virtual and frame clocks
+ * start at 0; the gravity timer is restarted from the new clock's current time.
+ * TG_CLOCK_FRAME keeps the game's current frame period, TG_FRAME_USEC_DEFAULT
+ * unless tg_set_frame_clock() changed it
+*/
+void tg_set_clock(TetrisGame *tg, enum tetris_clock_source source) {
+    tg->clock.source = source;
+    tg->clock.virtual_usec = 0;
+    if (source != TG_CLOCK_CUSTOM) {
+        tg->clock.now_fn = NULL;
+        tg->clock.ctx = NULL;
+    }
+    tg->last_gravity_tick_usec = tg_clock_now_usec(tg);
+}
+
+/**
+ * Use a deterministic frame clock: every tg_tick() advances game time
+ * by `frame_usec`, so gravity fires after a fixed number of ticks
+*/
+void tg_set_frame_clock(TetrisGame *tg, uint32_t frame_usec) {
+    tg_set_clock(tg, TG_CLOCK_FRAME);
+    tg->clock.frame_usec = frame_usec;
+}
+
+/**
+ * Use a caller-supplied clock function returning microseconds
+*/
+void tg_set_custom_clock(TetrisGame *tg, tetris_clock_fn now_fn, void *ctx) {
+    assert(now_fn != NULL && "custom clock needs a clock function");
+    tg->clock.now_fn = now_fn;
+    tg->clock.ctx = ctx;
+    tg_set_clock(tg, TG_CLOCK_CUSTOM);
+}
+
+/**
+ * Move a virtual or frame clock forward by `usec`
+*/
+void tg_advance_clock(TetrisGame *tg, uint64_t usec) {
+    assert((tg->clock.source == TG_CLOCK_VIRTUAL || tg->clock.source == TG_CLOCK_FRAME) && \
+        "only virtual clocks can be advanced");
+    tg->clock.virtual_usec += usec;
+}
+
+/**
+ * Read current time from the game's clock source
+ * @returns time in microseconds
+*/
+uint64_t tg_clock_now_usec(TetrisGame *tg) {
+    switch (tg->clock.source) {
+        case TG_CLOCK_MONOTONIC: {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+        }
+
+        case TG_CLOCK_VIRTUAL:
+        case TG_CLOCK_FRAME:
+            return tg->clock.virtual_usec;
+
+        case TG_CLOCK_CUSTOM:
+            return tg->clock.now_fn(tg->clock.ctx);
+
+        case TG_CLOCK_WALL:
+        default: {
+            struct timeval tv;
+            gettimeofday(&tv, NULL);
+            return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+        }
+    }
+}
+
+
+/**
+ * splitmix64 step, used to expand a seed into xoshiro state
+*/
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Seed the game's rng. Also empties the 7-bag so the next piece starts a new 
+ * bag, leaving the identity permutation in it so the bag is never 
+ * uninitialized memory (snapshots copy it)
+*/
+void tg_seed_rng(TetrisGame *tg, uint64_t seed) {
+    uint64_t x = seed;
+    uint64_t a = splitmix64(&x);
+    uint64_t b = splitmix64(&x);
+    tg->rng.s[0] = (uint32_t) a;
+    tg->rng.s[1] = (uint32_t) (a >> 32);
+    tg->rng.s[2] = (uint32_t) b;
+    tg->rng.s[3] = (uint32_t) (b >> 32);
+    for (int i = 0; i < NUM_TETROMINOS; i++)
+        tg->rng.bag[i] = i;
+    tg->rng.bag_idx = NUM_TETROMINOS;
+    tg->seed = seed;
+}
+
+/**
+ * Select how new pieces are picked, see enum tetris_randomizer
+*/
+void tg_set_randomizer(TetrisGame *tg, enum tetris_randomizer mode) {
+    tg->rng.mode = mode;
+    tg->rng.bag_idx = NUM_TETROMINOS;
+}
+
+static inline uint32_t rotl32(const uint32_t x, int k) {
+    return (x << k) | (x >> (32 - k));
+}
+
+/**
+ * Next 32 random bits from a xoshiro128** generator
+*/
+static uint32_t rng_next(TetrisRng *rng) {
+    uint32_t *s = rng->s;
+    const uint32_t result = rotl32(s[1] * 5, 7) * 9;
+    const uint32_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl32(s[3], 11);
+
+    return result;
+}
+
+// random number in range [0, bound), without the bias of `%`. Lemire's 
+//  multiply-shift with rejection: the few low products that would make some 
+//  results more likely are redrawn, which only costs a division when the 
+//  product lands below `bound`
+static uint32_t rng_below(TetrisRng *rng, uint32_t bound) {
+    uint64_t m = (uint64_t) rng_next(rng) * bound;
+    if ((uint32_t) m < bound) {
+        uint32_t threshold = -bound % bound;
+        while ((uint32_t) m < threshold)
+            m = (uint64_t) rng_next(rng) * bound;
+    }
+    return (uint32_t) (m >> 32);
+}
+
+static enum piece_type rng_next_ptype(TetrisRng *rng) {
+    if (rng->mode == TG_RANDOM_UNIFORM)
+        return rng_below(rng, NUM_TETROMINOS);
+
+    // 7-bag: refill and shuffle (Fisher-Yates) once the bag runs out
+    if (rng->bag_idx >= NUM_TETROMINOS) {
+        for (int i = 0; i < NUM_TETROMINOS; i++)
+            rng->bag[i] = i;
+        for (int i = NUM_TETROMINOS - 1; i > 0; i--) {
+            uint32_t j = rng_below(rng, i + 1);
+            uint8_t tmp = rng->bag[i];
+            rng->bag[i] = rng->bag[j];
+            rng->bag[j] = tmp;
+        }
+        rng->bag_idx = 0;
+    }
+    return rng->bag[rng->bag_idx++];
+}
+
+/**
+ * Next 32 random bits from the game's xoshiro128** generator
+*/
+uint32_t tg_rand(TetrisGame *tg) {
+    return rng_next(&tg->rng);
+}
+
+/**
+ * Random number in range [0, bound), without the bias of `%`
+*/
+uint32_t tg_rand_below(TetrisGame *tg, uint32_t bound) {
+    return rng_below(&tg->rng, bound);
+}
+
+/**
+ * Draw the next piece type from the game's randomizer
+*/
+enum piece_type tg_next_ptype(TetrisGame *tg) {
+    return rng_next_ptype(&tg->rng);
+}
+
+/**
+ * Preview the next `count` piece types the game will spawn, without 
+ * consuming them. Works on a copy of the rng, so the game is unchanged
+*/
+void tg_peek_ptypes(const TetrisGame *tg, enum piece_type *out, uint8_t count) {
+    TetrisRng rng = tg->rng;
+    for (uint8_t i = 0; i < count; i++)
+        out[i] = rng_next_ptype(&rng);
 }
 
 
@@ -188,14 +784,83 @@ TetrisBoard render_active_board(TetrisGame *tg) {
         // update board to reflect placement of piece
         gameboard.board[tp.loc.row + curr_offset.row] \
             [tp.loc.col + curr_offset.col] = tp.ptype;
+        TETRIS_ROW_MASK(&gameboard, tp.loc.row + curr_offset.row) |= \
+            TETRIS_COL_BIT(tp.loc.col + curr_offset.col);
 
     }
 
     tg->active_board = gameboard;
 
+    // full render, so incremental rendering can pick up from here
+    tg->rendered_piece = tp;
+    tg->rendered_board_gen = tg->board_gen;
+    tg->active_board_valid = true;
+    tg->active_board_gen++;
+
     return gameboard;
 }
 
+/**
+ * Write the cells of piece `tp` into `ab`. Stamps the piece's color if `stamp`,
+ * otherwise puts back whatever `tb` (the locked stack) has in those cells
+*/
+static inline void draw_piece_cells(TetrisBoard *ab, const TetrisBoard *tb, \
+    const TetrisPiece tp, bool stamp) {
+
+    for (int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
+        int row = tp.loc.row + TETROMINOS[tp.ptype][tp.orientation][i].row;
+        int col = tp.loc.col + TETROMINOS[tp.ptype][tp.orientation][i].col;
+        assert(row >= 0 && row < TETRIS_ROWS && col >= 0 && col < TETRIS_COLS && \
+            "piece cell out of bounds");
+
+        uint32_t bit = TETRIS_COL_BIT(col);
+        if (stamp) {
+            ab->board[row][col] = tp.ptype;
+            TETRIS_ROW_MASK(ab, row) |= bit;
+        }
+        else {
+            ab->board[row][col] = tb->board[row][col];
+            TETRIS_ROW_MASK(ab, row) = (TETRIS_ROW_MASK(ab, row) & ~bit) | \
+                (TETRIS_ROW_MASK(tb, row) & bit);
+        }
+    }
+}
+
+/**
+ * Update active_board without copying whole boards: if only the active piece
+ * moved, its old cells are restored from tg->board and its new cells stamped.
+ * Falls back to a full render_active_board() when tg->board has changed
+ * @returns true if active_board changed (and active_board_gen was bumped), 
+ *  false if there was nothing to redraw
+*/
+bool render_active_board_incremental(TetrisGame *tg) {
+    if (!tg->active_board_valid || tg->rendered_board_gen != tg->board_gen) {
+        render_active_board(tg);
+        return true;
+    }
+
+    TetrisPiece tp = tg->active_piece;
+    TetrisPiece old = tg->rendered_piece;
+    if (tp.ptype == old.ptype && tp.orientation == old.orientation && \
+        tp.loc.row == old.loc.row && tp.loc.col == old.loc.col)
+        return false;
+
+    draw_piece_cells(&tg->active_board, &tg->board, old, false);
+    draw_piece_cells(&tg->active_board, &tg->board, tp, true);
+
+    tg->rendered_piece = tp;
+    tg->active_board_gen++;
+    return true;
+}
+
+/**
+ * Let the incremental renderer know tg->board was modified. 
+ * Needed after editing the board directly (restoring a save, etc.)
+*/
+void tg_board_changed(TetrisGame *tg) {
+    tg->board_gen++;
+}
+
 /** 
  * Updates game score based on # lines cleared, including
  * level and gravity tick rate.
@@ -217,43 +882,42 @@ void tg_update_score(TetrisGame *tg, uint8_t lines_cleared) {
         tg->lines_cleared_since_last_level = tg->lines_cleared_since_last_level % 10;
         assert(tg->lines_cleared_since_last_level < 10);
 
-        // when the level increases, the gravity tick speeds up if it's still above the floor
-        if (tg->gravity_tick_rate_usec > GRAVITY_TICK_RATE_FLOOR) {
+        // when the level increases, the gravity tick speeds up until it reaches the floor
+        if (tg->gravity_tick_rate_usec >= GRAVITY_TICK_RATE_FLOOR + GRAVITY_TICK_RATE_DELTA) {
             tg->gravity_tick_rate_usec -= GRAVITY_TICK_RATE_DELTA;
         }
-        assert(tg->gravity_tick_rate_usec > GRAVITY_TICK_RATE_FLOOR && \
+        assert(tg->gravity_tick_rate_usec >= GRAVITY_TICK_RATE_FLOOR && \
             "Gravity tick rate below minimum possible value (if unit testing, " && \
             "check calls to reset_game_gravity_time()!");
 
-        #ifdef DEBUG_T
-        fprintf(gamelog, "Level increased! lvl=%d, lines_cleared_since_last_lvl=%d, grav_tick_rate usec=%d\n", \
-            tg->level,tg->lines_cleared_since_last_level, tg->gravity_tick_rate_usec); 
-        #endif
+        TG_LOG(tg, TG_EV_LEVEL_UP, tg->level, tg->lines_cleared_since_last_level, \
+            tg->gravity_tick_rate_usec);
     }
 
-    #ifdef DEBUG_T
-        fprintf(gamelog, "Score updated for %d lines cleared. Score = %d, Level = %d \
-    Lines cleared since last level=%d - highest_row=%d\n", lines_cleared, tg->score, tg->level, 
+    TG_LOG(tg, TG_EV_SCORE, lines_cleared, tg->score, tg->level, \
         tg->lines_cleared_since_last_level, tg->board.highest_occupied_cell);
-        fflush(gamelog);
-    #endif
 
 }
 
 /**
- * Creates and initializes a new active piece
+ * Creates and initializes a new active piece. If it doesn't fit at 
+ * the spawn point, the stack has topped out and the game is over
 */
 TetrisPiece create_rand_piece(TetrisGame *tg) {
     // create new piece and place in middle center
     TetrisPiece new_piece;
 
-    new_piece.ptype = rand() % NUM_TETROMINOS;
+    new_piece.ptype = tg_next_ptype(tg);
     new_piece.orientation = 0;
-    new_piece.loc.col = TETRIS_COLS / 2;
-    new_piece.loc.row = 1;
+    new_piece.loc.col = TETRIS_SPAWN_COL;
+    new_piece.loc.row = TETRIS_SPAWN_ROW;
     new_piece.falling = true;
 
     tg->active_piece = new_piece;
+    if (!test_piece_position(&tg->board, new_piece))
+        tg->game_over = true;
+    if (tg->rewind)
+        tg_rewind_record(tg);
     return new_piece;
 }
 
@@ -263,26 +927,8 @@ TetrisPiece create_rand_piece(TetrisGame *tg) {
 */
 bool check_valid_move(TetrisGame *tg, uint8_t player_move){
     TetrisPiece tp = tg->active_piece;
-    tetris_location tp_cells[NUM_CELLS_IN_TETROMINO];
 
-    // copy offsets for current piece into tp_cells
-    memcpy(tp_cells, TETROMINOS[tp.ptype][tp.orientation], sizeof(tp_cells));
-
-    // change those offsets to global piece locations
-    for(int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
-        tp_cells[i].row += tp.loc.row;
-        tp_cells[i].col += tp.loc.col;
-    }
-    #ifdef DEBUG_T
-        fprintf(gamelog, "Global piece locations are: {");
-        for(int i = 0; i < 4; i++)
-            fprintf(gamelog, "[%d, %d] ", tp_cells[i].row, tp_cells[i].col);
-
-        fprintf(gamelog, "}\n");
-        fflush(gamelog);
-    #endif
-
-    bool move_valid = true;
+    TG_LOG(tg, TG_EV_CHECK_MOVE, tp.ptype, tp.orientation, tp.loc.row, tp.loc.col, player_move);
 
     switch (player_move) {
         case T_NONE:
@@ -290,45 +936,38 @@ bool check_valid_move(TetrisGame *tg, uint8_t player_move){
             break;
 
         case T_UP:
-            #ifdef DEBUG_T
-                fprintf(gamelog, "player_move=%d \n", player_move);
-                fflush(gamelog);
-            #endif
+            TG_LOG(tg, TG_EV_CHECK_MOVE_ROTATE, player_move);
             assert(false && "rotate move should not be passed to check_valid_move()!");
             break;
 
         case T_DOWN:
-            const tetris_location down_offset = {.row = 1, .col = 0};
-            for(int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
-                move_valid = move_valid && test_piece_offset(&tg->board, tp_cells[i], down_offset);
-            }
-            break;
+            tp.loc.row += 1;
+            return test_piece_position(&tg->board, tp);
 
         case T_LEFT:
-            const tetris_location left_offset = {.row = 0, .col = -1};
-            // test all 4 cells in tetronimo; if any are false, move is invalid
-            for(int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
-                move_valid = move_valid && test_piece_offset(&tg->board, tp_cells[i], left_offset);
-            }
-            break;
+            tp.loc.col -= 1;
+            return test_piece_position(&tg->board, tp);
 
         case T_RIGHT:
-            const tetris_location right_offset = {.row = 0, .col = 1};
-            for(int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
-                move_valid = move_valid && test_piece_offset(&tg->board, tp_cells[i], right_offset);
-            }
-            break;
+            tp.loc.col += 1;
+            return test_piece_position(&tg->board, tp);
 
         default:
-            #ifdef DEBUG_T
-            fprintf(gamelog, "check_valid_move default case, not good!  ");
-            fprintf(gamelog, "player_move=%d \n", player_move);
-            #endif
+            TG_LOG(tg, TG_EV_CHECK_MOVE_BAD, player_move);
             break;
     }
 
 
-    return move_valid;
+    return true;
+}
+
+/**
+ * Helper to test a single board cell against the occupancy bitboard. 
+ * Cells within TETRIS_BOARD_PAD outside the board hit the sentinel walls, 
+ * floor or ceiling and count as occupied, so there's no range check
+*/
+static inline uint32_t board_cell_occupied(const TetrisBoard *tb, int row, int col) {
+    return TETRIS_ROW_MASK(tb, row) & TETRIS_COL_BIT(col);
 }
 
 /**
@@ -338,55 +977,85 @@ bool check_valid_move(TetrisGame *tg, uint8_t player_move){
 inline bool test_piece_offset(TetrisBoard *tb, const tetris_location global_loc, \
     const tetris_location move_offset) {
 
-    tetris_location testing_loc;    // location we want to move to
-    testing_loc.row = global_loc.row + move_offset.row;
-    testing_loc.col = global_loc.col + move_offset.col;
-
-    // if cell is unoccupied and not out of range
-    if (tb->board[testing_loc.row][testing_loc.col] == -1 && \
-        testing_loc.row > -1 && testing_loc.row < TETRIS_ROWS && \
-        testing_loc.col > -1 && testing_loc.col < TETRIS_COLS)
-        return true;
-    else
-        return false;
+    return !board_cell_occupied(tb, global_loc.row + move_offset.row, \
+        global_loc.col + move_offset.col);
 }
 
 /**
- * Test if next rotation of piece tp is valid
+ * Test if piece `tp` fits on the board at its current location and orientation;
+ * one mask test per cell against tb->occupancy, OR'd together without branching
+ * @note tp.loc must be at most one move or rotation away from a position on
+ *  the board, which is always true for pieces moved by the game logic
 */
-bool test_piece_rotate(TetrisBoard *tb, const TetrisPiece tp) {
-    tetris_location tp_cells[NUM_CELLS_IN_TETROMINO];
-    // copy offsets for next orientation of piece into tp_cells
-    memcpy(tp_cells, TETROMINOS[tp.ptype][(tp.orientation + 1) % 4], sizeof(tp_cells));
-    // change those offsets to global piece locations
-    for(int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
-        tp_cells[i].row += tp.loc.row;
-        tp_cells[i].col += tp.loc.col;
-    }
+bool test_piece_position(const TetrisBoard *tb, const TetrisPiece tp) {
+    const tetris_location *offsets = TETROMINOS[tp.ptype][tp.orientation];
 
-    #ifdef DEBUG_T
-        fprintf(gamelog, "Current orientation=%d, orientation after rotation = %d\n", \
-            tp.orientation, ((tp.orientation+1) % 4));
-        fflush(gamelog);
-    #endif
+    return !(board_cell_occupied(tb, tp.loc.row + offsets[0].row, tp.loc.col + offsets[0].col) | \
+        board_cell_occupied(tb, tp.loc.row + offsets[1].row, tp.loc.col + offsets[1].col) | \
+        board_cell_occupied(tb, tp.loc.row + offsets[2].row, tp.loc.col + offsets[2].col) | \
+        board_cell_occupied(tb, tp.loc.row + offsets[3].row, tp.loc.col + offsets[3].col));
+}
 
-    tetris_location testing_loc = tp_cells[0];
+/**
+ * Check every cell of piece `tp` is inside the board, so it's safe to hand 
+ * to test_piece_position() and friends no matter where it came from
+ * @note tp.ptype and tp.orientation must be in range
+*/
+bool piece_on_board(const TetrisPiece tp) {
+    const tetris_location *offsets = TETROMINOS[tp.ptype][tp.orientation];
 
-    for(int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
-        testing_loc = tp_cells[i];
-        // if cell is unoccupied and not out of range
-        if (tb->board[testing_loc.row][testing_loc.col] == -1 && \
-            testing_loc.row > -1 && testing_loc.row < TETRIS_ROWS && \
-            testing_loc.col > -1 && testing_loc.col < TETRIS_COLS)
-            continue;
-        else
+    for (int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
+        int row = tp.loc.row + offsets[i].row;
+        int col = tp.loc.col + offsets[i].col;
+        if (row < 0 || row >= TETRIS_ROWS || col < 0 || col >= TETRIS_COLS)
             return false;
     }
-
-    // if we're here, rotation is valid
     return true;
 }
 
+/**
+ * How many rows piece `tp` can fall straight down before landing on the stack
+ * or the floor. Uses the column masks to find the first occupied cell under 
+ * each piece cell, so it's 4 lookups no matter how far the drop is
+ * @note tp must be at a valid position on the board
+*/
+uint8_t piece_drop_distance(const TetrisBoard *tb, const TetrisPiece tp) {
+    const tetris_location *offsets = TETROMINOS[tp.ptype][tp.orientation];
+    uint8_t drop = TETRIS_ROWS;
+
+    for (int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
+        int row = tp.loc.row + offsets[i].row;
+        int col = tp.loc.col + offsets[i].col;
+        assert(row >= 0 && row < TETRIS_ROWS && col >= 0 && col < TETRIS_COLS);
+
+        // occupied rows below this cell, with the floor as an extra set bit
+        uint64_t below = ((uint64_t) tb->col_occupancy[col] | (1ULL << TETRIS_ROWS)) & \
+            (~0ULL << (row + 1));
+        uint8_t cell_drop = __builtin_ctzll(below) - row - 1;
+        if (cell_drop < drop)
+            drop = cell_drop;
+    }
+    return drop;
+}
+
+/**
+ * Row the active piece would land on if dropped straight down from where it
+ * is now; a display can draw a ghost piece there
+*/
+int8_t tg_landing_row(TetrisGame *tg) {
+    return tg->active_piece.loc.row + piece_drop_distance(&tg->board, tg->active_piece);
+}
+
+/**
+ * Test if next rotation of piece tp is valid
+*/
+bool test_piece_rotate(TetrisBoard *tb, const TetrisPiece tp) {
+    TetrisPiece rotated = tp;
+    rotated.orientation = (tp.orientation + 1) % 4;
+
+    return test_piece_position(tb, rotated);
+}
+
 
 
 /** 
@@ -399,30 +1068,26 @@ bool test_piece_rotate(TetrisBoard *tb, const TetrisPiece tp) {
  * that this function will need to be modified when porting to other platforms
 */
 bool check_do_piece_gravity(TetrisGame *tg) {
-    // get curr system time
-    struct timeval curr_time_usec;
-    gettimeofday(&curr_time_usec, NULL);
+    // get curr game time
+    uint64_t curr_time_usec = tg_clock_now_usec(tg);
 
-    // check if it's time for piece to be moved down
-    int32_t time_diff_usec = get_elapsed_us(tg->last_gravity_tick_usec, curr_time_usec);
+    // check if it's time for piece to be moved down. unsigned subtraction, so
+    //  this stays correct even if the clock value wraps
+    uint64_t time_diff_usec = curr_time_usec - tg->last_gravity_tick_usec;
 
-    if (time_diff_usec > tg->gravity_tick_rate_usec) {
+    if (time_diff_usec >= tg->gravity_tick_rate_usec) {
 
         // if can move down
         if(check_valid_move(tg, T_DOWN)) {
             tg->active_piece.loc.row += 1; // move location down
-            #ifdef DEBUG_T
-                fprintf(gamelog, "Gravity tick activated systime=%ld, last tick=%ld: piece moved down\n", \
-                    curr_time_usec.tv_usec, tg->last_gravity_tick_usec.tv_usec);
-            #endif
+            TG_LOG(tg, TG_EV_GRAVITY_DROP, (int32_t) tg->last_gravity_tick_usec, \
+                (int32_t) (tg->last_gravity_tick_usec >> 32));
             tg->last_gravity_tick_usec = curr_time_usec;  // update gravity tick
 
         }
         else {
             // if can't move piece down, change falling to false and ret false
-            #ifdef DEBUG_T
-                fprintf(gamelog, "Gravity tick activated: move down failed\n");
-            #endif
+            TG_LOG(tg, TG_EV_GRAVITY_BLOCKED, 0);
             tg->active_piece.falling = false;
             return false;
         }
@@ -439,12 +1104,86 @@ bool check_do_piece_gravity(TetrisGame *tg) {
  * @returns true if yes, false if no
 */
 bool check_filled_row(TetrisGame *tg, const uint8_t row) {
-    
-    for (int c = 0; c < TETRIS_COLS; c++) {
-        if(tg->board.board[row][c] == -1)
-            return false;
+    return TETRIS_ROW_MASK(&tg->board, row) == TETRIS_FULL_ROW_MASK;
+}
+
+/**
+ * clear_rows() without bumping board_gen, so a clear split into several 
+ * runs only counts as one board change
+*/
+static void remove_rows(TetrisGame *tg, uint8_t top_row, uint8_t num_rows) {
+    // starting at `row`, go up until you reach the top of the board
+    assert(num_rows <= 4 && top_row <= TETRIS_ROWS - num_rows + 1);
+
+    // hash out the cleared rows, and move the rows above down num_rows, 
+    //  one key per row each way
+    for (int row = top_row; row < top_row + num_rows; row++)
+        tg->board.hash ^= zobrist_row_hash(row, TETRIS_ROW_MASK(&tg->board, row));
+    for (int row = 1; row < top_row; row++) {
+        uint32_t row_mask = TETRIS_ROW_MASK(&tg->board, row);
+        if (row_mask != TETRIS_EMPTY_ROW_MASK)
+            tg->board.hash ^= zobrist_row_hash(row, row_mask) ^ \
+                zobrist_row_hash(row + num_rows, row_mask);
     }
-    return true;
+
+    // move every row from 1 to top_row - 1 down by num_rows, overwriting the
+    //  cleared rows. row 0 is never pulled from, so we stop before reading
+    //  OOB locations in the tetris grid. both planes shift as whole rows
+    if (top_row > 1) {
+        memmove(&tg->board.board[num_rows + 1], &tg->board.board[1], \
+            (top_row - 1) * sizeof(tg->board.board[0]));
+        memmove(&TETRIS_ROW_MASK(&tg->board, num_rows + 1), &TETRIS_ROW_MASK(&tg->board, 1), \
+            (top_row - 1) * sizeof(tg->board.occupancy[0]));
+    }
+
+    // clear rows at the very top of the board, where we want to avoid 
+    //  reading garbage from invalid board locations
+    for (int row = num_rows; row > 0; row--) {
+        assert(row < TETRIS_ROWS);
+        memset(tg->board.board[row], BG_COLOR, sizeof(tg->board.board[row]));
+        TETRIS_ROW_MASK(&tg->board, row) = TETRIS_EMPTY_ROW_MASK;
+    }
+
+    // same shift on the column masks: row 0 stays, rows 1..top_row-1 move 
+    //  down num_rows, and everything below the cleared rows is untouched. 
+    //  Each column's filled cell count just loses what was in the cleared 
+    //  rows, so heights and holes follow from the new masks without a 
+    //  popcount. Bumpiness and wells only depend on height differences, so 
+    //  they only need redoing if the columns didn't all drop the same amount
+    static const uint8_t nibble_cells[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+    const uint64_t shifted_rows = ((1ULL << top_row) - 1) & ~1ULL;
+    const uint64_t kept_rows = ~((1ULL << (top_row + num_rows)) - 1) | 1ULL;
+    const uint64_t cleared_rows = (1ULL << num_rows) - 1;
+    TetrisBoard *tb = &tg->board;
+    bool uniform_drop = true;
+    int first_drop = 0;
+    for (int col = 0; col < TETRIS_COLS; col++) {
+        uint64_t mask = tb->col_occupancy[col];
+        uint32_t shifted = (uint32_t) ((mask & kept_rows) | ((mask & shifted_rows) << num_rows));
+        tb->col_occupancy[col] = shifted;
+
+        uint8_t cells = tb->col_height[col] - tb->col_holes[col] - \
+            nibble_cells[((mask & ~kept_rows) >> top_row) & cleared_rows];
+        uint8_t height = shifted ? TETRIS_ROWS - __builtin_ctz(shifted) : 0;
+        int drop = tb->col_height[col] - height;
+        if (col == 0)
+            first_drop = drop;
+        uniform_drop &= drop == first_drop;
+
+        tb->holes += (height - cells) - tb->col_holes[col];
+        tb->col_height[col] = height;
+        tb->col_holes[col] = height - cells;
+    }
+    if (!uniform_drop)
+        compute_neighbor_metrics(tb);
+
+    // move highest occupied cell down by how many rows were cleared. If 
+    //  those were the top of the stack, it's the next non-empty row down, 
+    //  or the bottom row (like init_board()) once the board is empty
+    int highest = tg->board.highest_occupied_cell + num_rows;
+    while (highest < TETRIS_ROWS - 1 && TETRIS_ROW_MASK(&tg->board, highest) == TETRIS_EMPTY_ROW_MASK)
+        highest++;
+    tg->board.highest_occupied_cell = highest < TETRIS_ROWS ? highest : TETRIS_ROWS - 1;
 }
 
 /**
@@ -457,28 +1196,8 @@ bool check_filled_row(TetrisGame *tg, const uint8_t row) {
 */
 
 void clear_rows(TetrisGame *tg, uint8_t top_row, uint8_t num_rows) {
-    // starting at `row`, go up until you reach the top of the board
-    assert(num_rows <= 4 && top_row <= TETRIS_ROWS - num_rows + 1);
-
-    //  for each col on the board
-    for (int col = 0; col < TETRIS_COLS; col++) {
-        // starting at bottom row, move everything above it down
-        // by num_rows. stop when you would start pulling from OOB
-        //  locations in tetris grid
-        for (int row = top_row + num_rows - 1; row - num_rows > 0; row--) {
-            // get next row and move it down
-            tg->board.board[row][col] = tg->board.board[row-num_rows][col];
-        }
-        // clear rows at the very top of the board, where we want to avoid 
-        //  reading garbage from invalid board locations
-        for (int row = num_rows; row > 0; row--) {
-            assert(row < TETRIS_ROWS);
-            tg->board.board[row][col] = BG_COLOR;
-        }
-    }
-
-    // move highest occupied cell down by how many rows were cleared
-    tg->board.highest_occupied_cell += num_rows;
+    remove_rows(tg, top_row, num_rows);
+    tg->board_gen++;
 }
 
 
@@ -498,7 +1217,7 @@ uint8_t check_and_clear_rows(TetrisGame *tg, tetris_location *tp_cells) {
      * check the row of every cell in the piece;
      * which might mean checking the same row twice
     */ 
-    uint8_t rows_to_clear[4];
+    uint8_t rows_to_clear[4] = {0};
     uint8_t rows_idx = 0;       // index (and size) of rows_to_clear
     uint8_t row_with_offset;
     uint8_t piece_max_row = TETRIS_ROWS;
@@ -507,9 +1226,7 @@ uint8_t check_and_clear_rows(TetrisGame *tg, tetris_location *tp_cells) {
 
         // assert(row_with_offset < TETRIS_ROWS && row_with_offset >= 0 && "global row out of bounds");
         assert(row_with_offset < TETRIS_ROWS && "global row out of bounds");
-        #ifdef DEBUG_T
-        fprintf(gamelog, "check_and_clear: checking row %d\n", row_with_offset);
-        #endif
+        TG_LOG(tg, TG_EV_CHECK_ROW, row_with_offset);
 
         // if row is full, add it to list of rows to clear
         if(check_filled_row(tg, row_with_offset)) {
@@ -532,26 +1249,37 @@ uint8_t check_and_clear_rows(TetrisGame *tg, tetris_location *tp_cells) {
     // if this piece contains the new tallest cell on the board, update highest_occupied_cell accordingly
     if (piece_max_row <  tg->board.highest_occupied_cell) {
         tg->board.highest_occupied_cell = piece_max_row;
-        #ifdef DEBUG_T
-        fprintf(gamelog, "piece max is new highest row; row=%d\n", piece_max_row);
-        #endif
+        TG_LOG(tg, TG_EV_NEW_HIGHEST_ROW, piece_max_row);
 
     }
 
     // if we have rows to clear:
     if (rows_idx > 0) {
-        // convert rows_to_clear to int16 to prevent issues
-        // int16_t rows_to_clear_int16[4];
-        // uint8_to_int16_arr(rows_to_clear, rows_to_clear_int16, rows_idx );
-        // find top row in rows_to_clear and clear rows
-        uint8_t top_row = smallest_in_arr(rows_to_clear, rows_idx);
-        // uint8_t top_row = (uint8_t) smallest_in_arr(rows_to_clear_int16, rows_idx);
-        #ifdef DEBUG_T
-            fprintf(gamelog, "clearing %d rows with top_row=%d\n", rows_idx, top_row);
-            fflush(gamelog);
-        #endif
+        TG_LOG(tg, TG_EV_CLEAR_ROWS, rows_idx, rows_to_clear[0], rows_to_clear[1], \
+            rows_to_clear[2], rows_to_clear[3]);
+
+        // full rows aren't always next to each other (an I piece can fill 
+        //  rows 28, 29 and 31 but not 30), so sort them and clear each run 
+        //  of adjacent rows separately. Clearing a run only moves the rows 
+        //  above it, so going top run first keeps the lower runs in place
+        for (int i = 1; i < rows_idx; i++) {
+            for (int j = i; j > 0 && rows_to_clear[j - 1] > rows_to_clear[j]; j--) {
+                uint8_t tmp = rows_to_clear[j];
+                rows_to_clear[j] = rows_to_clear[j - 1];
+                rows_to_clear[j - 1] = tmp;
+            }
+        }
 
-        clear_rows(tg, top_row, rows_idx);
+        TG_STATS_BEGIN(tg, clear);
+        for (int i = 0; i < rows_idx; ) {
+            int run = 1;
+            while (i + run < rows_idx && rows_to_clear[i + run] == rows_to_clear[i] + run)
+                run++;
+            remove_rows(tg, rows_to_clear[i], run);
+            i += run;
+        }
+        tg->board_gen++;
+        TG_STATS_END(tg, clear, TG_STAT_CLEAR);
     }
 
     return rows_idx;
@@ -573,14 +1301,29 @@ bool check_and_spawn_new_piece(TetrisGame *tg) {
 
     // if we're here, we must have landed
     TetrisPiece tp = tg->active_piece; // last active piece
+    TG_STATS_BEGIN(tg, spawn);
 
-    #ifdef DEBUG_T
-        fprintf(gamelog, "Piece stopped falling at loc row=%d, col=%d, curr highest_row=%d\n", \
-            tp.loc.row, tp.loc.col, tg->board.highest_occupied_cell);
-        fflush(gamelog);
-    #endif
+    TG_LOG(tg, TG_EV_PIECE_LANDED, tp.loc.row, tp.loc.col, tg->board.highest_occupied_cell);
 
-    // set up active piece and array of offsets from current loc
+    uint8_t cleared_rows = lock_piece(tg, tp);
+    if (cleared_rows > 0)
+        tg_update_score(tg, cleared_rows);
+
+
+    // NOW, WE SPAWN NEW PIECE
+    create_rand_piece(tg);
+    TG_STATS_END(tg, spawn, TG_STAT_SPAWN_LOCK);
+
+    return true;
+}
+
+/**
+ * Add piece `tp` to the board where it is and clear any rows it fills. 
+ * Doesn't touch score or the active piece, so it can also be used to try 
+ * placements out on a scratch game
+ * @returns number of cleared rows
+*/
+uint8_t lock_piece(TetrisGame *tg, const TetrisPiece tp) {
     tetris_location tp_cells[NUM_CELLS_IN_TETROMINO];       // board location of all 4 cells in piece
     for (int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
         tp_cells[i] = TETROMINOS[tp.ptype][tp.orientation][i];
@@ -590,36 +1333,79 @@ bool check_and_spawn_new_piece(TetrisGame *tg) {
     }
 
 
+    // a piece covers at most 4 rows; hash them out before and back in after
+    int first_row = TETRIS_ROWS, last_row = 0;
+    for (int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
+        if (tp_cells[i].row < first_row)
+            first_row = tp_cells[i].row;
+        if (tp_cells[i].row > last_row)
+            last_row = tp_cells[i].row;
+    }
+    for (int row = first_row; row <= last_row; row++)
+        tg->board.hash ^= zobrist_row_hash(row, TETRIS_ROW_MASK(&tg->board, row));
+
     // add piece to board
+    int first_col = TETRIS_COLS, last_col = 0;
     for(int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
         // set global locations on board equal to piece color
         tg->board.board[tp_cells[i].row][tp_cells[i].col] = tp.ptype;
+        TETRIS_ROW_MASK(&tg->board, tp_cells[i].row) |= TETRIS_COL_BIT(tp_cells[i].col);
+        tg->board.col_occupancy[tp_cells[i].col] |= 1u << tp_cells[i].row;
+        if (tp_cells[i].col < first_col)
+            first_col = tp_cells[i].col;
+        if (tp_cells[i].col > last_col)
+            last_col = tp_cells[i].col;
     }
+    for (int row = first_row; row <= last_row; row++)
+        tg->board.hash ^= zobrist_row_hash(row, TETRIS_ROW_MASK(&tg->board, row));
+    update_column_metrics(&tg->board, first_col, last_col);
+    tg->board_gen++;
 
     // check for filled rows and clear them
-    uint8_t cleared_rows = check_and_clear_rows(tg, tp_cells);
-    if (cleared_rows > 0)
-        tg_update_score(tg, cleared_rows);
-
-
-    // NOW, WE SPAWN NEW PIECE
-    create_rand_piece(tg);
+    return check_and_clear_rows(tg, tp_cells);
+}
 
-    return true;
+/**
+ * Lock piece `tp` where it is, clear rows, and update score, level, and 
+ * gravity rate the way a piece landing in tg_tick() would, but without 
+ * reading the clock or spawning the next piece from the rng. The active 
+ * piece is left alone for the caller to replace, so search code can walk 
+ * a game forward one placement at a time. Placements are checked in full, 
+ * since they can come from anywhere (a search, a file, a network peer)
+ * @returns what the placement did, with valid false if it didn't fit
+*/
+TetrisApplyResult tg_apply_placement(TetrisGame *tg, const TetrisPiece tp) {
+    TetrisApplyResult res = {.valid = false, .game_over = tg->game_over};
+    if ((unsigned) tp.ptype >= NUM_TETROMINOS || tp.orientation >= NUM_ORIENTATIONS || \
+        !piece_on_board(tp) || !test_piece_position(&tg->board, tp))
+        return res;
+
+    res.valid = true;
+    uint32_t score_before = tg->score;
+    res.lines_cleared = lock_piece(tg, tp);
+    if (res.lines_cleared > 0)
+        tg_update_score(tg, res.lines_cleared);
+    res.score_gained = tg->score - score_before;
+    res.game_over = check_game_over(tg);
+    return res;
 }
 
 
 
 
 /**
- * Check if we've reached a game over state
+ * Check if we've reached a game over state: the last piece spawned on 
+ * top of the stack, or the stack reached the spawn row
  * @returns true if game over, false otherwise. Sets
  * tg.game_over on true state. 
 */
 bool check_game_over(TetrisGame *tg) {
+    if (tg->game_over)
+        return true;
 
-    // if we get to 1 as a highest occupied cell, stop
-    if (tg->board.highest_occupied_cell == 1) {
+    // if we get to 1 (or above) as a highest occupied cell, stop. A piece 
+    //  locked in row 0 used to skip straight past this check
+    if (tg->board.highest_occupied_cell <= TETRIS_SPAWN_ROW) {
         tg->game_over = true;
         return true;
     }
@@ -653,14 +1439,6 @@ uint8_t smallest_in_arr(uint8_t arr[], uint8_t arr_size) {
         }
     }
 
-    #ifdef DEBUG_T
-        fprintf(gamelog, "smallest value in array {");
-        for (int i = 0; i < arr_size; i++) {
-            fprintf(gamelog, "%d, ", arr[i]);
-        }
-        fprintf(gamelog, "} is %d!\n", smallestVal);
-    #endif
-
     return smallestVal;
 }
 
@@ -671,15 +1449,8 @@ uint8_t smallest_in_arr(uint8_t arr[], uint8_t arr_size) {
  * 
 */
 inline int32_t get_elapsed_us(struct timeval before, struct timeval after) {
-    int32_t elapsed_us;
-
-    if (after.tv_usec >= before.tv_usec) {
-        elapsed_us = after.tv_usec - before.tv_usec;
-    }
-    else {
-        elapsed_us = 100000 + after.tv_usec - before.tv_usec;
-    }
-    return elapsed_us;
+    return (int32_t) ((after.tv_sec - before.tv_sec) * 1000000 + \
+        (after.tv_usec - before.tv_usec));
 }
 
 /**
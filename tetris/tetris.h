@@ -16,12 +16,15 @@
 #include <stdio.h>
 #include <stdlib.h>         // used for malloc(), free()
 #include <string.h>         // memcpy
+#include <stddef.h>         // offsetof
 #include <sys/time.h>       // timeval for microsecond time intervals
+#include <time.h>           // clock_gettime for the monotonic clock source
 
 
 // TETRIS GAME LOGIC DEBUG FLAG
-// all print/fprintf statements in tetris.c are gated by this flag. extremely helpful
-//  for debugging game logic, but should not be present in release builds 
+// debug logging is gated by this flag. tetris.c logs game logic events to a 
+//  per-game binary log (tetris_log.h), which is cheap enough to leave on for 
+//  soak runs; gamelog is still there for text from the driver and utils
 // #define DEBUG_T 1
 
 #ifdef DEBUG_T
@@ -40,18 +43,42 @@ extern FILE *gamelog;
 #define TETRIS_COLS 16
 #endif
 
+// occupancy bitboard: bit `col + TETRIS_BOARD_PAD` of a row mask is set when that
+//  cell is occupied. The board is surrounded by a TETRIS_BOARD_PAD wide border of
+//  permanently occupied sentinel cells (walls, floor, and ceiling), so collision
+//  checks need no range checks. A pad of 4 covers every piece offset tested one 
+//  move or rotation away from a valid position
+#define TETRIS_BOARD_PAD 4
+#define TETRIS_MASK_ROWS (TETRIS_ROWS + 2 * TETRIS_BOARD_PAD)
+// mask bit for board column `col`
+#define TETRIS_COL_BIT(col) (1u << ((col) + TETRIS_BOARD_PAD))
+// occupancy mask of board row `row`, valid for -TETRIS_BOARD_PAD <= row < TETRIS_ROWS + TETRIS_BOARD_PAD
+#define TETRIS_ROW_MASK(tb, row) ((tb)->occupancy[(row) + TETRIS_BOARD_PAD])
+// a row is full when its mask equals TETRIS_FULL_ROW_MASK, and empty rows only have wall bits
+#define TETRIS_FULL_ROW_MASK UINT32_MAX
+#define TETRIS_EMPTY_ROW_MASK (~(((1u << TETRIS_COLS) - 1) << TETRIS_BOARD_PAD))
+static_assert(TETRIS_COLS + 2 * TETRIS_BOARD_PAD <= 32, "board too wide for uint32_t row masks");
+// column masks have bit `row` set when that cell is occupied, no padding
+static_assert(TETRIS_ROWS <= 32, "board too tall for uint32_t column masks");
+
 
 // how many different piece types and orientations
 #define NUM_TETROMINOS 7
 #define NUM_ORIENTATIONS 4
 #define NUM_CELLS_IN_TETROMINO 4
 
+// where new pieces spawn
+#define TETRIS_SPAWN_ROW 1
+#define TETRIS_SPAWN_COL (TETRIS_COLS / 2)
+
 // how many microseconds faster game tick should be after each level increase
 #define GRAVITY_TICK_RATE_DELTA 10000
 // initial gravity tick rate (how fast between each gravity move down in microseconds)
 #define GRAVITY_TICK_RATE_INITIAL 200000
 // gravity_tick minimum where we won't decrease it any further past this point
 #define GRAVITY_TICK_RATE_FLOOR 20000
+// TG_CLOCK_FRAME period a new game starts with, until tg_set_frame_clock() (60 Hz)
+#define TG_FRAME_USEC_DEFAULT 16667
 
 // Points per line cleared, combos not implemented
 // See: https://tetris.wiki/Scoring
@@ -66,7 +93,8 @@ enum piece_colors {S_CELL_COLOR, Z_CELL_COLOR, T_CELL_COLOR, L_CELL_COLOR, J_CEL
 #define BG_COLOR -1
 
 // Define possible moves that can be taken by player
-enum player_move {T_NONE, T_UP, T_DOWN, T_LEFT, T_RIGHT, T_PLAYPAUSE, T_QUIT};
+// T_HARDDROP drops the active piece straight to its landing row and locks it
+enum player_move {T_NONE, T_UP, T_DOWN, T_LEFT, T_RIGHT, T_PLAYPAUSE, T_QUIT, T_HARDDROP};
 
 
 /**
@@ -101,15 +129,123 @@ typedef struct TetrisPiece {
  * Represents the game board
  * @param board 2D int8_t array representing board
  *  -1 means unoccupied, >0 indicates cell color by piece_colors[]
+ * @param occupancy uint32_t mask per row plus sentinel rows, access through 
+ *  TETRIS_ROW_MASK()/TETRIS_COL_BIT(). Kept in sync with `board` by the game logic;
+ *  if you write to `board` directly, call rebuild_board_occupancy() afterwards
  * @param highest_occupied_row uint8_t tallest point in current stack, tracked to 
  *  avoid needless recomputation and help indicate gameover condition
+ * @param col_occupancy uint32_t mask per column, bit `row` set when board[row][col] 
+ *  is occupied
+ * @param col_height uint8_t filled height of each column, counted up from the floor
+ * @param col_holes uint8_t empty cells below the top of each column
+ * @param holes uint16_t sum of col_holes
+ * @param bumpiness uint16_t sum of height differences between neighboring columns
+ * @param well_depth uint16_t sum over columns of how far each sits below both
+ *  neighbors (walls count as full height)
+ * @param hash uint64_t Zobrist hash of which cells are occupied (colors don't 
+ *  count), XOR of tg_zobrist_key() over every row
+ * The column metrics and hash are kept up to date as pieces lock and rows clear, 
+ * so they're only maintained for tg->board and not for active_board
 */
 typedef struct TetrisBoard {
     int8_t board[TETRIS_ROWS][TETRIS_COLS];
+    uint32_t occupancy[TETRIS_MASK_ROWS];
     uint8_t highest_occupied_cell;
 
+    uint32_t col_occupancy[TETRIS_COLS];
+    uint8_t col_height[TETRIS_COLS];
+    uint8_t col_holes[TETRIS_COLS];
+    uint16_t holes;
+    uint16_t bumpiness;
+    uint16_t well_depth;
+    uint64_t hash;
 } TetrisBoard;
 
+/**
+ * Time sources the game can use for gravity timing, see tg_set_clock()
+ * TG_CLOCK_WALL - gettimeofday(), default
+ * TG_CLOCK_MONOTONIC - clock_gettime(CLOCK_MONOTONIC), immune to wall clock jumps
+ * TG_CLOCK_VIRTUAL - only moves when the caller runs tg_advance_clock()
+ * TG_CLOCK_FRAME - virtual clock advanced by a fixed frame period on every tg_tick()
+ * TG_CLOCK_CUSTOM - caller-supplied function, eg a platform RTC or esp_timer
+*/
+enum tetris_clock_source {TG_CLOCK_WALL, TG_CLOCK_MONOTONIC, TG_CLOCK_VIRTUAL, \
+    TG_CLOCK_FRAME, TG_CLOCK_CUSTOM};
+
+// custom clock callback, returns current time in microseconds
+typedef uint64_t (*tetris_clock_fn)(void *ctx);
+
+/**
+ * Game time source. All times are 64 bit microseconds, so they never wrap
+ * @param source which clock to read
+ * @param now_fn callback for TG_CLOCK_CUSTOM
+ * @param ctx user pointer passed to now_fn
+ * @param virtual_usec current time for TG_CLOCK_VIRTUAL/TG_CLOCK_FRAME
+ * @param frame_usec how far TG_CLOCK_FRAME advances per tg_tick()
+*/
+typedef struct TetrisClock {
+    enum tetris_clock_source source;
+    tetris_clock_fn now_fn;
+    void *ctx;
+    uint64_t virtual_usec;
+    uint32_t frame_usec;
+} TetrisClock;
+
+/**
+ * Piece randomizer modes, see tg_set_randomizer()
+ * TG_RANDOM_UNIFORM - every piece is an independent uniform pick
+ * TG_RANDOM_7BAG - pieces are dealt from shuffled bags of all 7 tetrominos
+*/
+enum tetris_randomizer {TG_RANDOM_UNIFORM, TG_RANDOM_7BAG};
+
+/**
+ * Per-game random number generator (xoshiro128**), so games don't share 
+ * state through the global rand() and can be replayed from their seed
+ * @param s xoshiro128** state
+ * @param mode piece randomizer mode
+ * @param bag current 7-bag, only used in TG_RANDOM_7BAG mode
+ * @param bag_idx index of next piece in bag, NUM_TETROMINOS when bag is empty
+*/
+typedef struct TetrisRng {
+    uint32_t s[4];
+    enum tetris_randomizer mode;
+    uint8_t bag[NUM_TETROMINOS];
+    uint8_t bag_idx;
+} TetrisRng;
+
+/**
+ * Phases of tg_tick() timed when built with TETRIS_STATS, see TetrisStats
+ * TG_STAT_GRAVITY - gravity timer check and moving the piece down
+ * TG_STAT_SPAWN_LOCK - locking a landed piece, scoring, and spawning the next one
+ * TG_STAT_CLEAR - clearing full rows
+ * TG_STAT_RENDER - incremental render of active_board
+ * TG_STAT_MOVE - applying the player's move
+*/
+enum tetris_stat_phase {TG_STAT_GRAVITY, TG_STAT_SPAWN_LOCK, TG_STAT_CLEAR, \
+    TG_STAT_RENDER, TG_STAT_MOVE, TG_NUM_STAT_PHASES};
+
+/**
+ * Tick instrumentation, only collected when the library is built with 
+ * TETRIS_STATS (CMake option TETRIS_STATS_MACRO). Phase times are 
+ * exclusive, so a row clear inside a lock only counts as TG_STAT_CLEAR, 
+ * and a hard drop's lock only as TG_STAT_SPAWN_LOCK
+ * @param ticks tg_tick() calls
+ * @param calls times each phase ran
+ * @param nsec monotonic nanoseconds spent in each phase
+ * @param nested_nsec time spent in phases nested inside the one being 
+ *  timed, subtracted from it when it finishes
+*/
+typedef struct TetrisStats {
+    uint64_t ticks;
+    uint64_t calls[TG_NUM_STAT_PHASES];
+    uint64_t nsec[TG_NUM_STAT_PHASES];
+    uint64_t nested_nsec;
+} TetrisStats;
+
+// see tetris_rewind.h and tetris_log.h
+struct TetrisRewind;
+struct TetrisLog;
+
 /**
  * Tetris Game Struct
  * @param board 2D struct array of set pieces on board
@@ -120,7 +256,20 @@ typedef struct TetrisBoard {
  * @param score uint32_t player's current score
  * @param level uint32_t current level
  * @param lines_cleared_since_last_level - uint8_t 
- * @param last_gravity_tick_usec - `struct timeval` last time active_piece was moved down
+ * @param last_gravity_tick_usec - uint64_t clock time (usec) active_piece was last moved down
+ * @param clock - TetrisClock time source used for gravity
+ * @param rng - TetrisRng used to pick new pieces
+ * @param seed - uint64_t seed rng was last seeded with
+ * @param board_gen - uint32_t bumped every time `board` changes
+ * @param active_board_gen - uint32_t bumped every time `active_board` changes; 
+ *  displays can skip drawing while it stays the same
+ * @param rendered_piece - piece currently drawn into active_board
+ * @param rendered_board_gen - board_gen that active_board was built from
+ * @param active_board_valid - false until active_board has been fully rendered
+ * @param rewind - ring of recent states for tg_rewind(), NULL unless 
+ *  tg_enable_rewind() was called
+ * @param stats - TetrisStats tick instrumentation, only with TETRIS_STATS
+ * @param log - binary event log, only with DEBUG_T
 */
 typedef struct TetrisGame {
     TetrisBoard board;
@@ -132,11 +281,43 @@ typedef struct TetrisGame {
     uint32_t gravity_tick_rate_usec;
     uint8_t lines_cleared_since_last_level;
 
-    // uint32_t last_gravity_tick_usec;
-    // this requires <sys/time.h>
-    struct timeval last_gravity_tick_usec;
+    uint64_t last_gravity_tick_usec;
+    TetrisClock clock;
+    TetrisRng rng;
+    uint64_t seed;
+
+    // incremental rendering state
+    uint32_t board_gen;
+    uint32_t active_board_gen;
+    TetrisPiece rendered_piece;
+    uint32_t rendered_board_gen;
+    bool active_board_valid;
+
+    struct TetrisRewind *rewind;
+
+    #ifdef TETRIS_STATS
+    TetrisStats stats;
+    #endif
+    #ifdef DEBUG_T
+    struct TetrisLog *log;
+    #endif
 } TetrisGame;
 
+/**
+ * What tg_apply_placement() did to the game
+ * @param valid false if the piece was off the board or overlapped the 
+ *  stack, in which case the game wasn't touched
+ * @param lines_cleared rows cleared by the placement
+ * @param score_gained points added to tg->score
+ * @param game_over true if the placement topped the game out
+*/
+typedef struct TetrisApplyResult {
+    bool valid;
+    uint8_t lines_cleared;
+    uint32_t score_gained;
+    bool game_over;
+} TetrisApplyResult;
+
 ////////////////////////////////////////
 //////       FUNCTION DEFS        //////
 ////////////////////////////////////////
@@ -144,16 +325,52 @@ typedef struct TetrisGame {
 // init/end functions
 
 TetrisGame* create_game(void);
+TetrisGame* create_game_seeded(uint64_t seed);
+TetrisGame* create_game_in(void *buf);
+TetrisGame* create_game_seeded_in(void *buf, uint64_t seed);
 void end_game(TetrisGame *tg);
+void end_game_in(TetrisGame *tg);
+void tg_clone_into(TetrisGame *dst, const TetrisGame *src);
 TetrisBoard init_board(void);
+void rebuild_board_occupancy(TetrisBoard *tb);
+uint64_t tg_zobrist_key(int row, uint32_t cells);
+uint64_t tg_board_hash(const TetrisBoard *tb);
 
 // This is the main function for using this library; all game state is handled internally
 
 bool tg_tick(TetrisGame *tg, enum player_move move);
+bool tg_tick_moves(TetrisGame *tg, const enum player_move *moves, uint32_t n);
+
+// game clock
+
+void tg_set_clock(TetrisGame *tg, enum tetris_clock_source source);
+void tg_set_frame_clock(TetrisGame *tg, uint32_t frame_usec);
+void tg_set_custom_clock(TetrisGame *tg, tetris_clock_fn now_fn, void *ctx);
+void tg_advance_clock(TetrisGame *tg, uint64_t usec);
+uint64_t tg_clock_now_usec(TetrisGame *tg);
+
+// tick instrumentation, stubs unless built with TETRIS_STATS
+
+bool tg_get_stats(const TetrisGame *tg, TetrisStats *out);
+void tg_reset_stats(TetrisGame *tg);
+void tg_dump_stats(const TetrisGame *tg, FILE *out);
+
+// per-game random number generator
+
+void tg_seed_rng(TetrisGame *tg, uint64_t seed);
+void tg_set_randomizer(TetrisGame *tg, enum tetris_randomizer mode);
+uint32_t tg_rand(TetrisGame *tg);
+uint32_t tg_rand_below(TetrisGame *tg, uint32_t bound);
+enum piece_type tg_next_ptype(TetrisGame *tg);
+void tg_peek_ptypes(const TetrisGame *tg, enum piece_type *out, uint8_t count);
 
 
 TetrisBoard render_active_board(TetrisGame *tg);
+bool render_active_board_incremental(TetrisGame *tg);
+void tg_board_changed(TetrisGame *tg);
 bool check_and_spawn_new_piece(TetrisGame *tg);
+uint8_t lock_piece(TetrisGame *tg, const TetrisPiece tp);
+TetrisApplyResult tg_apply_placement(TetrisGame *tg, const TetrisPiece tp);
 
 TetrisPiece create_rand_piece(TetrisGame *tg);
 
@@ -162,6 +379,10 @@ TetrisPiece create_rand_piece(TetrisGame *tg);
 bool check_valid_move(TetrisGame *tg, uint8_t player_move);
 bool test_piece_offset(TetrisBoard *tb, const tetris_location global_loc, const tetris_location move_offset);
 bool test_piece_rotate(TetrisBoard *tb, const TetrisPiece tp);
+bool test_piece_position(const TetrisBoard *tb, const TetrisPiece tp);
+bool piece_on_board(const TetrisPiece tp);
+uint8_t piece_drop_distance(const TetrisBoard *tb, const TetrisPiece tp);
+int8_t tg_landing_row(TetrisGame *tg);
 bool check_do_piece_gravity(TetrisGame *tg);
 
 bool check_filled_row(TetrisGame *tg, uint8_t row);
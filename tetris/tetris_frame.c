@@ -0,0 +1,80 @@
+/**
+ * Triple-buffered display frames
+ * @brief Lets a game run on its own thread while another thread draws it.
+ *  After each tick the game copies what the display needs into a frame
+ *  and publishes it; the render thread picks up the newest frame whenever
+ *  it's ready for one. A slow display only means frames get skipped, the
+ *  game thread never waits on it.
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#include "tetris_frame.h"
+
+
+/**
+ * Copy what a display needs from `tg` into `f`. Doesn't touch `f->seq`
+*/
+void tg_frame_capture(const TetrisGame *tg, TetrisFrame *f) {
+    memcpy(f->cells, tg->active_board.board, sizeof(f->cells));
+    f->active_board_gen = tg->active_board_gen;
+    f->score = tg->score;
+    f->level = tg->level;
+    f->lines_cleared_since_last_level = tg->lines_cleared_since_last_level;
+    f->game_over = tg->game_over;
+}
+
+/**
+ * Start `fb` with no frame published
+*/
+void tg_frames_init(TetrisFrameBuffer *fb) {
+    memset(fb->frames, 0, sizeof(fb->frames));
+    fb->back = 0;
+    atomic_init(&fb->middle, 1);
+    fb->front = 2;
+    fb->published = 0;
+}
+
+/**
+ * Frame for the game thread to fill before tg_frames_publish()
+*/
+TetrisFrame *tg_frames_back(TetrisFrameBuffer *fb) {
+    return &fb->frames[fb->back];
+}
+
+/**
+ * Hand the back frame to the render thread, replacing any frame it hasn't
+ * taken yet. Game thread only
+*/
+void tg_frames_publish(TetrisFrameBuffer *fb) {
+    fb->frames[fb->back].seq = fb->published++;
+    // release: the frame's contents are visible before the renderer can take it
+    uint8_t old = atomic_exchange_explicit(&fb->middle, fb->back | TG_FRAMES_NEW, memory_order_acq_rel);
+    fb->back = old & TG_FRAMES_IDX_MASK;
+}
+
+/**
+ * Capture `tg` into the back frame and publish it. Game thread only
+*/
+void tg_frames_publish_game(TetrisFrameBuffer *fb, const TetrisGame *tg) {
+    tg_frame_capture(tg, tg_frames_back(fb));
+    tg_frames_publish(fb);
+}
+
+/**
+ * Take the newest published frame. Render thread only; `*out` stays valid
+ * until its next call
+ * @returns false, with `*out` still the frame from last time, if nothing
+ *  was published since
+*/
+bool tg_frames_latest(TetrisFrameBuffer *fb, const TetrisFrame **out) {
+    bool fresh = false;
+    if (atomic_load_explicit(&fb->middle, memory_order_relaxed) & TG_FRAMES_NEW) {
+        // acquire: see everything the game wrote into the frame
+        uint8_t old = atomic_exchange_explicit(&fb->middle, fb->front, memory_order_acq_rel);
+        fb->front = old & TG_FRAMES_IDX_MASK;
+        fresh = true;
+    }
+    *out = &fb->frames[fb->front];
+    return fresh;
+}
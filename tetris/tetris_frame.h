@@ -0,0 +1,64 @@
+/**
+ * Triple-buffered display frames for the tetris game library
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#ifndef TETRIS_FRAME_H
+#define TETRIS_FRAME_H
+
+#include <stdatomic.h>
+
+#include "tetris.h"
+
+/**
+ * Everything a display needs to draw one frame of a game, copied out so it
+ * can be drawn on another thread while the game keeps ticking
+ * @param cells tg->active_board cells
+ * @param active_board_gen tg->active_board_gen they were copied at
+ * @param seq frames published before this one, set by tg_frames_publish()
+*/
+typedef struct TetrisFrame {
+    int8_t cells[TETRIS_ROWS][TETRIS_COLS];
+    uint32_t active_board_gen;
+    uint32_t score;
+    uint32_t level;
+    uint8_t lines_cleared_since_last_level;
+    bool game_over;
+    uint64_t seq;
+} TetrisFrame;
+
+// set in TetrisFrameBuffer.middle while it holds a frame the consumer hasn't taken
+#define TG_FRAMES_NEW 0x4
+#define TG_FRAMES_IDX_MASK 0x3
+
+/**
+ * Lock-free triple buffer handing frames from one game thread to one
+ * render thread. The game writes into `back` and publishes it by swapping
+ * it with `middle`; the renderer takes the newest frame by swapping
+ * `middle` with `front`. Neither side ever waits, frames the renderer
+ * was too slow for are skipped, and a frame is never changed while the
+ * renderer holds it
+ * @param middle index of the frame between the two threads, | TG_FRAMES_NEW
+ *  if it's newer than the renderer's
+ * @param back frame the game thread fills next, only it touches this
+ * @param front frame the render thread is drawing, only it touches this
+ * @param published frames published so far, game thread only
+*/
+typedef struct TetrisFrameBuffer {
+    TetrisFrame frames[3];
+    _Atomic uint8_t middle;
+    uint8_t back;
+    uint8_t front;
+    uint64_t published;
+} TetrisFrameBuffer;
+
+
+void tg_frame_capture(const TetrisGame *tg, TetrisFrame *f);
+void tg_frames_init(TetrisFrameBuffer *fb);
+TetrisFrame *tg_frames_back(TetrisFrameBuffer *fb);
+void tg_frames_publish(TetrisFrameBuffer *fb);
+void tg_frames_publish_game(TetrisFrameBuffer *fb, const TetrisGame *tg);
+bool tg_frames_latest(TetrisFrameBuffer *fb, const TetrisFrame **out);
+
+#endif
@@ -0,0 +1,53 @@
+/**
+ * Player input queue
+ * @brief Drivers push every move as it arrives, with a timestamp, and the
+ *  game loop takes everything queued once per tick and hands it to
+ *  tg_tick_moves(), so bursts of presses between ticks all land in order
+ *  on the next tick instead of being spread over later ticks or lost.
+ *  The timestamps let a frame clocked driver put each move on the frame
+ *  it arrived in.
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#include "tetris_input.h"
+
+
+/**
+ * Start `q` empty
+*/
+void tg_input_init(TetrisInputQueue *q) {
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->dropped, 0);
+}
+
+/**
+ * Number of moves waiting
+*/
+uint32_t tg_input_pending(TetrisInputQueue *q) {
+    return atomic_load_explicit(&q->head, memory_order_acquire) - \
+        atomic_load_explicit(&q->tail, memory_order_relaxed);
+}
+
+/**
+ * Take up to `max` moves off the front of `q`, oldest first, stopping at 
+ * the first one that arrived after `until_usec` (UINT64_MAX takes them all)
+ * @returns number of moves written to `moves`
+*/
+uint32_t tg_input_drain(TetrisInputQueue *q, enum player_move *moves, uint32_t max, uint64_t until_usec) {
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+    uint32_t n = 0;
+    while (tail != head && n < max) {
+        const TetrisInputEvent *ev = &q->events[tail & (TG_INPUT_CAPACITY - 1)];
+        if (ev->usec > until_usec)
+            break;
+        moves[n++] = ev->move;
+        tail++;
+    }
+
+    atomic_store_explicit(&q->tail, tail, memory_order_release);
+    return n;
+}
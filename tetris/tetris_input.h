@@ -0,0 +1,69 @@
+/**
+ * Timestamped player input queue for the tetris game library
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#ifndef TETRIS_INPUT_H
+#define TETRIS_INPUT_H
+
+#include <stdatomic.h>
+
+#include "tetris.h"
+
+// queued moves, a power of 2. More than a player can press between two ticks
+#define TG_INPUT_CAPACITY 64
+static_assert((TG_INPUT_CAPACITY & (TG_INPUT_CAPACITY - 1)) == 0, "TG_INPUT_CAPACITY must be a power of 2");
+
+/**
+ * One player move and when it came in
+ * @param usec time the input arrived, on whatever clock the driver pushes with
+ * @param move player_move
+*/
+typedef struct TetrisInputEvent {
+    uint64_t usec;
+    enum player_move move;
+} TetrisInputEvent;
+
+/**
+ * Single producer, single consumer ring of player moves, so an input
+ * handler (eg a key ISR, or a read loop) can queue every press as it
+ * happens and the game loop can apply them all on its next tick with
+ * tg_tick_moves(), instead of one move per tick
+ * @param head next event the producer writes
+ * @param tail next event the consumer reads
+ * @param dropped moves lost to a full queue
+*/
+typedef struct TetrisInputQueue {
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    _Atomic uint32_t dropped;
+    TetrisInputEvent events[TG_INPUT_CAPACITY];
+} TetrisInputQueue;
+
+
+/**
+ * Queue `move`, which came in at `usec`. Never blocks, so it's safe to
+ * call from an interrupt handler
+ * @returns false, counting it dropped, if the queue is full
+*/
+static inline bool tg_input_push(TetrisInputQueue *q, uint64_t usec, enum player_move move) {
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head - tail >= TG_INPUT_CAPACITY) {
+        atomic_fetch_add_explicit(&q->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    TetrisInputEvent *ev = &q->events[head & (TG_INPUT_CAPACITY - 1)];
+    ev->usec = usec;
+    ev->move = move;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return true;
+}
+
+void tg_input_init(TetrisInputQueue *q);
+uint32_t tg_input_pending(TetrisInputQueue *q);
+uint32_t tg_input_drain(TetrisInputQueue *q, enum player_move *moves, uint32_t max, uint64_t until_usec);
+
+#endif
@@ -0,0 +1,298 @@
+/**
+ * Binary event log
+ * @brief Replaces the fprintf()/fflush() calls DEBUG_T used to make from
+ *  inside the game logic. Games push fixed-size records into their own
+ *  lock-free ring, and a background thread drains every ring to one file
+ *  (TG_LOG_FILENAME), so logging costs a few stores per event instead of
+ *  a formatted write. tg_log_format() turns records back into the old
+ *  text lines, for tetris_logdump and for unit tests, which print the
+ *  text to stdout as before.
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#include "tetris_log.h"
+
+
+// guards the list of logs and the sink
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+// serializes opening and closing logs, so the drain thread is started and
+//  joined by one caller at a time without holding log_lock across the join
+static pthread_mutex_t log_lifecycle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drain_cv = PTHREAD_COND_INITIALIZER;
+static pthread_t drain_thread;
+static bool drain_stop = false;
+
+static TetrisLog *log_list = NULL;
+static uint32_t log_users = 0;
+static uint16_t next_game_id = 0;
+static FILE *log_out = NULL;
+static bool log_text = false;
+
+
+static void *drain_main(void *arg) {
+    (void) arg;
+    pthread_mutex_lock(&log_lock);
+    while (!drain_stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += TG_LOG_DRAIN_USEC * 1000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&drain_cv, &log_lock, &deadline);
+
+        uint32_t drained = 0;
+        for (TetrisLog *log = log_list; log != NULL; log = log->next)
+            drained += tg_log_drain(log, log_out, log_text);
+        if (drained > 0)
+            fflush(log_out);
+    }
+    pthread_mutex_unlock(&log_lock);
+    return NULL;
+}
+
+/**
+ * Have the drain thread empty the rings now instead of at its next 
+ * interval. Doesn't take the lock, so the game thread never blocks here; 
+ * a wakeup missed while the drain thread is busy just waits for the next
+*/
+void tg_log_wake_drain(void) {
+    pthread_cond_signal(&drain_cv);
+}
+
+/**
+ * Open the shared sink and start the drain thread, for the first log
+ * @returns false if the log file can't be created
+*/
+static bool open_sink(void) {
+    #ifdef TETRIS_UNIT_TEST_DEF
+    // unit tests print the text to stdout so it shows up in the CI console
+    log_out = stdout;
+    log_text = true;
+    #else
+    log_out = fopen(TG_LOG_FILENAME, "wb");
+    if (log_out == NULL)
+        return false;
+    log_text = false;
+
+    TetrisLogHeader header = {.version = TG_LOG_VERSION, .record_size = sizeof(TetrisLogRecord)};
+    memcpy(header.magic, TG_LOG_MAGIC, sizeof(header.magic));
+    fwrite(&header, sizeof(header), 1, log_out);
+    #endif
+
+    drain_stop = false;
+    if (pthread_create(&drain_thread, NULL, drain_main, NULL) != 0) {
+        if (log_out != stdout)
+            fclose(log_out);
+        log_out = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Create a game's log ring and register it with the drain thread
+ * @returns NULL if it can't be allocated or the log file can't be created
+*/
+TetrisLog *tg_log_open(void) {
+    TetrisLog *log = malloc(sizeof(TetrisLog));
+    if (log == NULL)
+        return NULL;
+    atomic_init(&log->head, 0);
+    atomic_init(&log->tail, 0);
+    atomic_init(&log->dropped, 0);
+
+    pthread_mutex_lock(&log_lifecycle_lock);
+    if (log_users == 0 && !open_sink()) {
+        pthread_mutex_unlock(&log_lifecycle_lock);
+        free(log);
+        return NULL;
+    }
+    log_users++;
+
+    pthread_mutex_lock(&log_lock);
+    log->game = next_game_id++;
+    log->next = log_list;
+    log_list = log;
+    pthread_mutex_unlock(&log_lock);
+    pthread_mutex_unlock(&log_lifecycle_lock);
+    return log;
+}
+
+/**
+ * Write out whatever `log` has left, unregister and free it. The last
+ * log to close stops the drain thread and closes the file. Safe with NULL
+*/
+void tg_log_close(TetrisLog *log) {
+    if (log == NULL)
+        return;
+
+    pthread_mutex_lock(&log_lifecycle_lock);
+    pthread_mutex_lock(&log_lock);
+    for (TetrisLog **l = &log_list; *l != NULL; l = &(*l)->next) {
+        if (*l == log) {
+            *l = log->next;
+            break;
+        }
+    }
+    tg_log_drain(log, log_out, log_text);
+    uint32_t dropped = atomic_load(&log->dropped);
+    if (dropped > 0)
+        fprintf(stderr, "tetris log: game %u dropped %u records\n", log->game, dropped);
+    fflush(log_out);
+
+    bool last = --log_users == 0;
+    if (last) {
+        drain_stop = true;
+        pthread_cond_signal(&drain_cv);
+    }
+    pthread_mutex_unlock(&log_lock);
+
+    if (last) {
+        pthread_join(drain_thread, NULL);
+        if (log_out != stdout)
+            fclose(log_out);
+        log_out = NULL;
+    }
+    pthread_mutex_unlock(&log_lifecycle_lock);
+    free(log);
+}
+
+/**
+ * Move every record waiting in `log` to `out`, raw or as text. Only one
+ * thread may drain a given log at a time
+ * @returns number of records written
+*/
+uint32_t tg_log_drain(TetrisLog *log, FILE *out, bool text) {
+    uint32_t tail = atomic_load_explicit(&log->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&log->head, memory_order_acquire);
+    uint32_t count = head - tail;
+
+    while (tail != head) {
+        uint32_t idx = tail & (TG_LOG_CAPACITY - 1);
+        if (text) {
+            tg_log_format(&log->records[idx], out);
+            tail++;
+        }
+        else {
+            // write up to the end of the ring in one go
+            uint32_t n = head - tail;
+            if (n > TG_LOG_CAPACITY - idx)
+                n = TG_LOG_CAPACITY - idx;
+            fwrite(&log->records[idx], sizeof(TetrisLogRecord), n, out);
+            tail += n;
+        }
+    }
+
+    atomic_store_explicit(&log->tail, tail, memory_order_release);
+    return count;
+}
+
+/**
+ * Print a record as the text line DEBUG_T used to write for it
+*/
+void tg_log_format(const TetrisLogRecord *rec, FILE *out) {
+    const int32_t *a = rec->args;
+    switch (rec->event) {
+        case TG_EV_GAME_END:
+            fprintf(out, "Deallocating tetris game\n");
+            break;
+
+        case TG_EV_GAME_OVER:
+            fprintf(out, "game over detected, returning false from tg_tick\n");
+            break;
+
+        case TG_EV_TICK_BAD_MOVE:
+            fprintf(out, "tg_tick default case! uhoh  player_move=%d \n", a[0]);
+            break;
+
+        case TG_EV_ROTATE:
+            fprintf(out, "Current orientation=%d, orientation after rotation = %d\n", a[0], a[1]);
+            break;
+
+        case TG_EV_LEVEL_UP:
+            fprintf(out, "Level increased! lvl=%d, lines_cleared_since_last_lvl=%d, grav_tick_rate usec=%d\n", \
+                a[0], a[1], a[2]);
+            break;
+
+        case TG_EV_SCORE:
+            fprintf(out, "Score updated for %d lines cleared. Score = %d, Level = %d     "
+                "Lines cleared since last level=%d - highest_row=%d\n", a[0], a[1], a[2], a[3], a[4]);
+            break;
+
+        case TG_EV_CHECK_MOVE:
+            if (a[0] < 0 || a[0] >= NUM_TETROMINOS || a[1] < 0 || a[1] >= NUM_ORIENTATIONS) {
+                fprintf(out, "Global piece locations are: {bad piece %d/%d}\n", a[0], a[1]);
+                break;
+            }
+            fprintf(out, "Global piece locations are: {");
+            for (int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
+                fprintf(out, "[%d, %d] ", TETROMINOS[a[0]][a[1]][i].row + a[2], \
+                    TETROMINOS[a[0]][a[1]][i].col + a[3]);
+            }
+            fprintf(out, "}\n");
+            break;
+
+        case TG_EV_CHECK_MOVE_ROTATE:
+            fprintf(out, "player_move=%d \n", a[0]);
+            break;
+
+        case TG_EV_CHECK_MOVE_BAD:
+            fprintf(out, "check_valid_move default case, not good!  player_move=%d \n", a[0]);
+            break;
+
+        case TG_EV_GRAVITY_DROP:
+            fprintf(out, "Gravity tick activated systime=%llu, last tick=%llu: piece moved down\n", \
+                (unsigned long long) rec->usec, \
+                (unsigned long long) (((uint64_t) (uint32_t) a[1] << 32) | (uint32_t) a[0]));
+            break;
+
+        case TG_EV_GRAVITY_BLOCKED:
+            fprintf(out, "Gravity tick activated: move down failed\n");
+            break;
+
+        case TG_EV_CHECK_ROW:
+            fprintf(out, "check_and_clear: checking row %d\n", a[0]);
+            break;
+
+        case TG_EV_NEW_HIGHEST_ROW:
+            fprintf(out, "piece max is new highest row; row=%d\n", a[0]);
+            break;
+
+        case TG_EV_CLEAR_ROWS: {
+            int n = a[0] < 0 ? 0 : (a[0] > TG_LOG_MAX_ARGS - 1 ? TG_LOG_MAX_ARGS - 1 : a[0]);
+            int32_t top_row = n > 0 ? a[1] : 0;
+            fprintf(out, "smallest value in array {");
+            for (int i = 0; i < n; i++) {
+                fprintf(out, "%d, ", a[i + 1]);
+                if (a[i + 1] < top_row)
+                    top_row = a[i + 1];
+            }
+            fprintf(out, "} is %d!\n", top_row);
+            fprintf(out, "clearing %d rows with top_row=%d\n", a[0], top_row);
+            break;
+        }
+
+        case TG_EV_PIECE_LANDED:
+            fprintf(out, "Piece stopped falling at loc row=%d, col=%d, curr highest_row=%d\n", \
+                a[0], a[1], a[2]);
+            break;
+
+        default:
+            fprintf(out, "unknown event %u\n", rec->event);
+            break;
+    }
+}
+
+/**
+ * Read and check the header at the start of a log file
+ * @returns false if it isn't a log file this version can read
+*/
+bool tg_log_read_header(FILE *in) {
+    TetrisLogHeader header;
+    return fread(&header, sizeof(header), 1, in) == 1 && \
+        memcmp(header.magic, TG_LOG_MAGIC, sizeof(header.magic)) == 0 && \
+        header.version == TG_LOG_VERSION && header.record_size == sizeof(TetrisLogRecord);
+}
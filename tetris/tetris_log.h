@@ -0,0 +1,141 @@
+/**
+ * Binary event log for the tetris game library
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#ifndef TETRIS_LOG_H
+#define TETRIS_LOG_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "tetris.h"
+
+// records per game ring, a power of 2. If the drain thread falls this far
+//  behind, new records are dropped (and counted) rather than blocking the game
+#ifndef TG_LOG_CAPACITY
+    #ifdef TETRIS_UNIT_TEST_DEF
+    // unit tests print every record as text, which drains much slower
+    #define TG_LOG_CAPACITY 65536
+    #else
+    #define TG_LOG_CAPACITY 16384
+    #endif
+#endif
+static_assert((TG_LOG_CAPACITY & (TG_LOG_CAPACITY - 1)) == 0, "TG_LOG_CAPACITY must be a power of 2");
+// how often the drain thread empties the rings
+#define TG_LOG_DRAIN_USEC 10000
+
+// log file header
+#define TG_LOG_MAGIC "TGLG"
+#define TG_LOG_VERSION 1
+// where games log to outside of unit tests, which print text to stdout
+#define TG_LOG_FILENAME "game.tgl"
+
+/**
+ * Events the game logic logs, with what each record's args hold. The
+ * names are from the DEBUG_T text log lines they replace, which
+ * tg_log_format() still prints
+*/
+enum tetris_log_event {
+    TG_EV_GAME_END,             // -
+    TG_EV_GAME_OVER,            // -
+    TG_EV_TICK_BAD_MOVE,        // move
+    TG_EV_ROTATE,               // orientation, orientation after rotation
+    TG_EV_LEVEL_UP,             // level, lines since last level, gravity tick rate usec
+    TG_EV_SCORE,                // lines cleared, score, level, lines since last level, highest row
+    TG_EV_CHECK_MOVE,           // ptype, orientation, row, col, move
+    TG_EV_CHECK_MOVE_ROTATE,    // move
+    TG_EV_CHECK_MOVE_BAD,       // move
+    TG_EV_GRAVITY_DROP,         // last gravity tick usec, low then high 32 bits
+    TG_EV_GRAVITY_BLOCKED,      // -
+    TG_EV_CHECK_ROW,            // row
+    TG_EV_NEW_HIGHEST_ROW,      // row
+    TG_EV_CLEAR_ROWS,           // number of rows, then up to 4 rows
+    TG_EV_PIECE_LANDED,         // row, col, highest row
+    TG_NUM_LOG_EVENTS
+};
+
+#define TG_LOG_MAX_ARGS 5
+
+/**
+ * One log entry. Fixed size so logging is a single struct write and a log
+ * file is an array of these after the header
+ * @param usec game clock when the event happened
+ * @param event tetris_log_event
+ * @param game id of the game that logged it, in the order games were created
+ * @param args event specific values
+*/
+typedef struct TetrisLogRecord {
+    uint64_t usec;
+    uint16_t event;
+    uint16_t game;
+    int32_t args[TG_LOG_MAX_ARGS];
+} TetrisLogRecord;
+
+static_assert(sizeof(TetrisLogRecord) == 32, "TetrisLogRecord layout has padding");
+
+/**
+ * Log file header
+ * @param magic TG_LOG_MAGIC
+ * @param version TG_LOG_VERSION
+ * @param record_size sizeof(TetrisLogRecord) when written
+*/
+typedef struct TetrisLogHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t record_size;
+} TetrisLogHeader;
+
+/**
+ * Per-game single producer, single consumer ring. The game thread only
+ * writes records and advances `head`; the drain thread only reads them
+ * and advances `tail`, so neither ever waits on the other
+ * @param head next record the game writes
+ * @param tail next record the drain thread reads
+ * @param dropped records lost to a full ring
+ * @param game id stamped on every record
+ * @param next registered logs, guarded by the drain thread's lock
+*/
+typedef struct TetrisLog {
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    _Atomic uint32_t dropped;
+    uint16_t game;
+    struct TetrisLog *next;
+    TetrisLogRecord records[TG_LOG_CAPACITY];
+} TetrisLog;
+
+
+void tg_log_wake_drain(void);
+
+/**
+ * Append a record to `log`, or count it dropped if the ring is full. 
+ * Wakes the drain thread early when the ring gets half full
+*/
+static inline void tg_log_push(TetrisLog *log, uint64_t usec, enum tetris_log_event event, \
+    const int32_t args[TG_LOG_MAX_ARGS]) {
+    uint32_t head = atomic_load_explicit(&log->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&log->tail, memory_order_acquire);
+    if (head - tail >= TG_LOG_CAPACITY) {
+        atomic_fetch_add_explicit(&log->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    TetrisLogRecord *rec = &log->records[head & (TG_LOG_CAPACITY - 1)];
+    rec->usec = usec;
+    rec->event = event;
+    rec->game = log->game;
+    memcpy(rec->args, args, sizeof(rec->args));
+    atomic_store_explicit(&log->head, head + 1, memory_order_release);
+    if (head - tail == TG_LOG_CAPACITY / 2)
+        tg_log_wake_drain();
+}
+
+TetrisLog *tg_log_open(void);
+void tg_log_close(TetrisLog *log);
+uint32_t tg_log_drain(TetrisLog *log, FILE *out, bool text);
+void tg_log_format(const TetrisLogRecord *rec, FILE *out);
+bool tg_log_read_header(FILE *in);
+
+#endif
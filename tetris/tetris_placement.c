@@ -0,0 +1,324 @@
+/**
+ * Reachable placement search
+ * @brief Search over every (orientation, row, col) a piece can reach from where
+ *  it starts, using the same moves tg_tick() accepts and the same collision
+ *  rules. Each (orientation, col) keeps its rows as a bitmask. The search runs
+ *  in generations: generation g is every state reachable with g rotations or
+ *  sideways moves, plus any number of T_DOWN moves in between. A generation
+ *  is a shift of the previous one sideways or into the next orientation,
+ *  followed by a fill down through the rows the piece fits in, so the whole
+ *  search only takes as many passes as the most shifts any placement needs.
+ *  States the piece can't move down from are where it would lock. The
+ *  generation of every state is recorded so paths can be walked back.
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#include "tetris_placement.h"
+
+#define PIECE_ROWS_MASK ((1ULL << TETRIS_PLACEMENT_ROWS) - 1)
+
+
+// state index of a piece, with row and col already shifted by the margin
+static inline uint16_t state_index(uint8_t orientation, int mcol, int mrow) {
+    return (orientation * TETRIS_PLACEMENT_COLS + mcol) * TETRIS_PLACEMENT_ROWS + mrow;
+}
+
+static inline bool mask_has(uint64_t mask, int mrow) {
+    return mrow >= 0 && mrow < TETRIS_PLACEMENT_ROWS && (mask >> mrow) & 1;
+}
+
+/**
+ * For every orientation and column, the rows where `ptype` fits on `tb`.
+ * A piece cell at offset (dr, dc) is free at piece row r when board row
+ * r + dr of column c + dc is empty, so each cell contributes that column's
+ * free-row mask shifted by -dr, and the piece fits where all 4 overlap
+*/
+static void compute_fits(const TetrisBoard *tb, enum piece_type ptype, TetrisPlacementList *pl) {
+    uint64_t free_rows[TETRIS_COLS];
+    for (int col = 0; col < TETRIS_COLS; col++) {
+        free_rows[col] = ~(uint64_t) tb->col_occupancy[col] & ((1ULL << TETRIS_ROWS) - 1);
+    }
+
+    for (int o = 0; o < NUM_ORIENTATIONS; o++) {
+        const tetris_location *offsets = TETROMINOS[ptype][o];
+        for (int mcol = 0; mcol < TETRIS_PLACEMENT_COLS; mcol++) {
+            uint64_t fit = PIECE_ROWS_MASK;
+            for (int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
+                int col = mcol - TETRIS_PLACEMENT_MARGIN + offsets[i].col;
+                if (col < 0 || col >= TETRIS_COLS) {
+                    fit = 0;
+                    break;
+                }
+                fit &= free_rows[col] << (TETRIS_PLACEMENT_MARGIN - offsets[i].row);
+            }
+            pl->fits[o][mcol] = fit & PIECE_ROWS_MASK;
+        }
+    }
+}
+
+/**
+ * Some pieces have orientations with identical cells (SQ has 1 distinct
+ * shape, S/Z/I have 2). For every orientation, find the first orientation
+ * with the same shape and the loc offset that lines its cells up, so
+ * placements covering the same cells are only reported once
+*/
+static void find_canonical_orientations(enum piece_type ptype, uint8_t canon[NUM_ORIENTATIONS], \
+    tetris_location canon_offset[NUM_ORIENTATIONS]) {
+
+    tetris_location corner[NUM_ORIENTATIONS];
+    uint16_t shape[NUM_ORIENTATIONS];
+
+    for (int o = 0; o < NUM_ORIENTATIONS; o++) {
+        const tetris_location *offsets = TETROMINOS[ptype][o];
+        corner[o] = offsets[0];
+        for (int i = 1; i < NUM_CELLS_IN_TETROMINO; i++) {
+            if (offsets[i].row < corner[o].row)
+                corner[o].row = offsets[i].row;
+            if (offsets[i].col < corner[o].col)
+                corner[o].col = offsets[i].col;
+        }
+
+        // cells relative to the top left corner, as a 4x4 bitmap
+        shape[o] = 0;
+        for (int i = 0; i < NUM_CELLS_IN_TETROMINO; i++) {
+            shape[o] |= 1u << ((offsets[i].row - corner[o].row) * 4 + offsets[i].col - corner[o].col);
+        }
+
+        canon[o] = o;
+        for (int prev = 0; prev < o; prev++) {
+            if (shape[prev] == shape[o]) {
+                canon[o] = prev;
+                break;
+            }
+        }
+        canon_offset[o].row = corner[o].row - corner[canon[o]].row;
+        canon_offset[o].col = corner[o].col - corner[canon[o]].col;
+    }
+}
+
+
+/**
+ * Spread `seeds` down through the contiguous runs of `fits` below them
+ * (higher bits are lower rows). Occluded fill, one shift per doubling of 
+ * the distance instead of one per row
+*/
+static inline uint64_t fill_down(uint64_t seeds, uint64_t fits) {
+    uint64_t reached = seeds & fits;
+    reached |= fits & (reached << 1);
+    fits &= fits << 1;
+    reached |= fits & (reached << 2);
+    fits &= fits << 2;
+    reached |= fits & (reached << 4);
+    fits &= fits << 4;
+    reached |= fits & (reached << 8);
+    fits &= fits << 8;
+    reached |= fits & (reached << 16);
+    fits &= fits << 16;
+    reached |= fits & (reached << 32);
+    return reached;
+}
+
+/**
+ * Per-search state for reporting placements
+ * @param pl list being filled
+ * @param canon first orientation with the same cells as each orientation
+ * @param canon_offset loc offset from each orientation to its canonical one
+*/
+typedef struct placement_search {
+    TetrisPlacementList *pl;
+    uint8_t canon[NUM_ORIENTATIONS];
+    tetris_location canon_offset[NUM_ORIENTATIONS];
+} placement_search;
+
+/**
+ * Record the generation of the states `reached` at (o, mcol), and report 
+ * the ones the piece can't fall from as placements
+*/
+static void record_generation(placement_search *search, int o, int mcol, uint64_t reached, \
+    uint16_t shifts) {
+
+    TetrisPlacementList *pl = search->pl;
+
+    // bit r of fits >> 1 is set when the row below r fits
+    uint64_t resting = reached & ~(pl->fits[o][mcol] >> 1);
+
+    while (reached) {
+        int mrow = __builtin_ctzll(reached);
+        reached &= reached - 1;
+        pl->shifts[state_index(o, mcol, mrow)] = shifts;
+    }
+
+    while (resting) {
+        int mrow = __builtin_ctzll(resting);
+        resting &= resting - 1;
+
+        uint8_t co = search->canon[o];
+        int cmcol = mcol + search->canon_offset[o].col;
+        uint64_t cbit = 1ULL << (mrow + search->canon_offset[o].row);
+        if (pl->emitted[co][cmcol] & cbit)
+            continue;
+        pl->emitted[co][cmcol] |= cbit;
+
+        TetrisPlacement *p = &pl->placements[pl->num_placements++];
+        p->loc.row = mrow - TETRIS_PLACEMENT_MARGIN;
+        p->loc.col = mcol - TETRIS_PLACEMENT_MARGIN;
+        p->orientation = o;
+        p->num_shifts = shifts;
+        // moves never go up, so every row between start and here is one T_DOWN
+        p->path_len = shifts + p->loc.row - pl->start.loc.row;
+    }
+}
+
+/**
+ * Find every distinct resting placement of `ptype` reachable from the
+ * spawn location on board `tb`
+ * @returns number of placements found, 0 if the spawn location is blocked
+*/
+uint16_t find_placements(const TetrisBoard *tb, enum piece_type ptype, TetrisPlacementList *pl) {
+    TetrisPiece start = {.ptype = ptype, .loc = {TETRIS_SPAWN_ROW, TETRIS_SPAWN_COL}, \
+        .orientation = 0, .falling = true};
+    return find_placements_from(tb, start, pl);
+}
+
+/**
+ * Find every distinct resting placement reachable from piece `start` through
+ * T_UP/T_DOWN/T_LEFT/T_RIGHT moves, in order of fewest rotations and 
+ * sideways moves needed to get there.
+ * @param tb board to search, only the column masks are read
+ * @param start piece to search from
+ * @param pl result list and search state, overwritten
+ * @returns number of placements found, 0 if `start` is blocked
+ * @note paths don't account for gravity; a bot feeding them to tg_tick needs
+ *  to make its moves faster than gravity, or hard drop on the final T_DOWN run
+*/
+uint16_t find_placements_from(const TetrisBoard *tb, const TetrisPiece start, TetrisPlacementList *pl) {
+    // current and next generation, with an empty column on either side so 
+    //  T_LEFT/T_RIGHT can read their neighbor without bounds checks
+    uint64_t gens[2][NUM_ORIENTATIONS][TETRIS_PLACEMENT_COLS + 2];
+
+    pl->start = start;
+    pl->num_placements = 0;
+    memset(pl->visited, 0, sizeof(pl->visited));
+    memset(pl->emitted, 0, sizeof(pl->emitted));
+    memset(gens, 0, sizeof(gens));
+
+    int start_mrow = start.loc.row + TETRIS_PLACEMENT_MARGIN;
+    int start_mcol = start.loc.col + TETRIS_PLACEMENT_MARGIN;
+    if (start_mcol < 0 || start_mcol >= TETRIS_PLACEMENT_COLS)
+        return 0;
+
+    compute_fits(tb, start.ptype, pl);
+    if (!mask_has(pl->fits[start.orientation][start_mcol], start_mrow))
+        return 0;
+
+    placement_search search = {.pl = pl};
+    find_canonical_orientations(start.ptype, search.canon, search.canon_offset);
+
+    // generation 0: the start and everything straight below it
+    uint64_t (*cur)[TETRIS_PLACEMENT_COLS + 2] = gens[0];
+    uint64_t (*next)[TETRIS_PLACEMENT_COLS + 2] = gens[1];
+    uint64_t reached = fill_down(1ULL << start_mrow, pl->fits[start.orientation][start_mcol]);
+    cur[start.orientation][start_mcol + 1] = reached;
+    pl->visited[start.orientation][start_mcol] = reached;
+    record_generation(&search, start.orientation, start_mcol, reached, 0);
+
+    for (uint16_t shifts = 1; ; shifts++) {
+        bool any = false;
+
+        // new states one T_UP from the previous orientation, T_LEFT from the
+        //  column to the right, or T_RIGHT from the column to the left, then 
+        //  everything they can fall to that hasn't been reached already
+        for (int o = 0; o < NUM_ORIENTATIONS; o++) {
+            int prev_o = (o + NUM_ORIENTATIONS - 1) % NUM_ORIENTATIONS;
+            for (int mcol = 0; mcol < TETRIS_PLACEMENT_COLS; mcol++) {
+                uint64_t open = pl->fits[o][mcol] & ~pl->visited[o][mcol];
+                uint64_t seeds = (cur[prev_o][mcol + 1] | cur[o][mcol + 2] | cur[o][mcol]) & open;
+                reached = seeds ? fill_down(seeds, open) : 0;
+                next[o][mcol + 1] = reached;
+                if (reached) {
+                    any = true;
+                    pl->visited[o][mcol] |= reached;
+                    record_generation(&search, o, mcol, reached, shifts);
+                }
+            }
+        }
+        if (!any)
+            break;
+
+        uint64_t (*tmp)[TETRIS_PLACEMENT_COLS + 2] = cur;
+        cur = next;
+        next = tmp;
+    }
+
+    return pl->num_placements;
+}
+
+// true if state (o, mcol, mrow) was reached in generation `shifts`
+static inline bool reached_in(const TetrisPlacementList *pl, int o, int mcol, int mrow, \
+    uint16_t shifts) {
+    return mcol >= 0 && mcol < TETRIS_PLACEMENT_COLS && mask_has(pl->visited[o][mcol], mrow) && \
+        pl->shifts[state_index(o, mcol, mrow)] == shifts;
+}
+
+/**
+ * Rebuild the moves that take the start piece to placement `idx`
+ * @param moves output, filled with placements[idx].path_len moves in the
+ *  order they should be passed to tg_tick
+ * @param max_moves size of `moves`, must be at least placements[idx].path_len
+ * @returns number of moves written
+*/
+uint16_t get_placement_path(const TetrisPlacementList *pl, uint16_t idx, \
+    enum player_move *moves, uint16_t max_moves) {
+
+    assert(idx < pl->num_placements);
+    const TetrisPlacement *p = &pl->placements[idx];
+    assert(p->path_len <= max_moves);
+
+    int o = p->orientation;
+    int mcol = p->loc.col + TETRIS_PLACEMENT_MARGIN;
+    int mrow = p->loc.row + TETRIS_PLACEMENT_MARGIN;
+    uint16_t shifts = p->num_shifts;
+
+    // walk back to the start, filling moves from the end. Every state either
+    //  fell from the row above in the same generation, or was entered from 
+    //  the previous generation by a shift. Falling is preferred, which puts 
+    //  the shifts as early in the path as possible, while the piece is still 
+    //  high up and gravity is least likely to get in the way
+    for (uint16_t i = p->path_len; i > 0; i--) {
+        int prev_o = (o + NUM_ORIENTATIONS - 1) % NUM_ORIENTATIONS;
+
+        if (reached_in(pl, o, mcol, mrow - 1, shifts)) {
+            moves[i - 1] = T_DOWN;
+            mrow -= 1;
+        }
+        else if (shifts > 0 && reached_in(pl, o, mcol + 1, mrow, shifts - 1)) {
+            moves[i - 1] = T_LEFT;
+            mcol += 1;
+            shifts--;
+        }
+        else if (shifts > 0 && reached_in(pl, o, mcol - 1, mrow, shifts - 1)) {
+            moves[i - 1] = T_RIGHT;
+            mcol -= 1;
+            shifts--;
+        }
+        else {
+            assert(shifts > 0 && reached_in(pl, prev_o, mcol, mrow, shifts - 1));
+            moves[i - 1] = T_UP;
+            o = prev_o;
+            shifts--;
+        }
+    }
+    return p->path_len;
+}
+
+/**
+ * Placement `idx` as a landed TetrisPiece
+*/
+TetrisPiece placement_to_piece(const TetrisPlacementList *pl, uint16_t idx) {
+    assert(idx < pl->num_placements);
+    const TetrisPlacement *p = &pl->placements[idx];
+    TetrisPiece tp = {.ptype = pl->start.ptype, .loc = p->loc, .orientation = p->orientation, \
+        .falling = false};
+    return tp;
+}
@@ -0,0 +1,69 @@
+/**
+ * Reachable placement search for the tetris game library
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#ifndef TETRIS_PLACEMENT_H
+#define TETRIS_PLACEMENT_H
+
+#include "tetris.h"
+
+// Cell offsets in TETROMINOS are within [-1, 3] and every orientation has a
+//  cell at offset >= 0, so a piece that passes test_piece_position() has its
+//  loc in [-TETRIS_PLACEMENT_MARGIN, TETRIS_ROWS) x [-TETRIS_PLACEMENT_MARGIN, TETRIS_COLS).
+//  The search indexes piece rows and cols shifted up by the margin
+#define TETRIS_PLACEMENT_MARGIN 3
+#define TETRIS_PLACEMENT_ROWS (TETRIS_ROWS + TETRIS_PLACEMENT_MARGIN)
+#define TETRIS_PLACEMENT_COLS (TETRIS_COLS + TETRIS_PLACEMENT_MARGIN)
+// every (orientation, row, col) a piece can be in
+#define TETRIS_PLACEMENT_STATES (NUM_ORIENTATIONS * TETRIS_PLACEMENT_ROWS * TETRIS_PLACEMENT_COLS)
+static_assert(TETRIS_PLACEMENT_ROWS < 64, "board too tall for uint64_t placement row masks");
+
+/**
+ * A final resting position of a piece
+ * @param loc piece location, same as TetrisPiece.loc
+ * @param orientation piece orientation [0-3]
+ * @param num_shifts number of T_UP/T_LEFT/T_RIGHT moves on the path here
+ * @param path_len number of moves on the path here, T_DOWN included
+*/
+typedef struct TetrisPlacement {
+    tetris_location loc;
+    uint8_t orientation;
+    uint16_t num_shifts;
+    uint16_t path_len;
+} TetrisPlacement;
+
+/**
+ * Result of find_placements(), plus the search state needed to rebuild
+ * input paths. Big enough that it should be allocated once and reused
+ * @param start piece the search started from
+ * @param num_placements number of entries in placements
+ * @param placements every distinct resting placement, in order of num_shifts
+ * @param fits per orientation and column, mask of piece rows (bit row + margin)
+ *  where the piece fits on the board
+ * @param visited same layout as fits, rows the search has reached
+ * @param emitted same layout as fits, placements already reported. Indexed by
+ *  the first orientation with the same cells, since SQ repeats one shape in
+ *  all 4 orientations and S/Z/I repeat 2
+ * @param shifts fewest T_UP/T_LEFT/T_RIGHT moves needed to reach each visited state
+*/
+typedef struct TetrisPlacementList {
+    TetrisPiece start;
+    uint16_t num_placements;
+    TetrisPlacement placements[TETRIS_PLACEMENT_STATES];
+
+    uint64_t fits[NUM_ORIENTATIONS][TETRIS_PLACEMENT_COLS];
+    uint64_t visited[NUM_ORIENTATIONS][TETRIS_PLACEMENT_COLS];
+    uint64_t emitted[NUM_ORIENTATIONS][TETRIS_PLACEMENT_COLS];
+    uint16_t shifts[TETRIS_PLACEMENT_STATES];
+} TetrisPlacementList;
+
+
+uint16_t find_placements(const TetrisBoard *tb, enum piece_type ptype, TetrisPlacementList *pl);
+uint16_t find_placements_from(const TetrisBoard *tb, const TetrisPiece start, TetrisPlacementList *pl);
+uint16_t get_placement_path(const TetrisPlacementList *pl, uint16_t idx, \
+    enum player_move *moves, uint16_t max_moves);
+TetrisPiece placement_to_piece(const TetrisPlacementList *pl, uint16_t idx);
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * TetrisGame pool
+ * @brief Hands out games from one contiguous, cache line aligned block, 
+ *  for hosting many short-lived games without a malloc/free per game. 
+ *  Free slots form a singly linked stack threaded through the slots 
+ *  themselves. Storage can come from tg_pool_create() or from the caller 
+ *  through tg_pool_init(), eg a static buffer where heap is scarce.
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#include "tetris_pool.h"
+
+
+static inline uint8_t *slot_ptr(const TetrisGamePool *pool, uint32_t idx) {
+    return pool->storage + (size_t) idx * TG_POOL_SLOT_SIZE;
+}
+
+/**
+ * Set up a pool over caller-owned storage, which must be TG_POOL_ALIGN 
+ * aligned. Holds storage_size / TG_POOL_SLOT_SIZE games
+*/
+void tg_pool_init(TetrisGamePool *pool, void *storage, size_t storage_size) {
+    assert((uintptr_t) storage % TG_POOL_ALIGN == 0 && "pool storage misaligned");
+    assert(storage_size / TG_POOL_SLOT_SIZE < TG_POOL_NONE);
+
+    pool->storage = storage;
+    pool->capacity = storage_size / TG_POOL_SLOT_SIZE;
+    pool->in_use = 0;
+    pool->owns_storage = false;
+
+    // chain every slot onto the free stack, lowest index on top
+    pool->free_head = pool->capacity > 0 ? 0 : TG_POOL_NONE;
+    for (uint32_t i = 0; i < pool->capacity; i++) {
+        uint32_t next = (i + 1 < pool->capacity) ? i + 1 : TG_POOL_NONE;
+        memcpy(slot_ptr(pool, i), &next, sizeof(next));
+    }
+}
+
+/**
+ * Allocate a pool with room for `capacity` games
+ * @returns pool, or NULL if allocation failed
+*/
+TetrisGamePool *tg_pool_create(uint32_t capacity) {
+    TetrisGamePool *pool = malloc(sizeof(TetrisGamePool));
+    if (pool == NULL)
+        return NULL;
+
+    // aligned_alloc needs the size to be a multiple of the alignment, 
+    //  which whole slots always are
+    void *storage = aligned_alloc(TG_POOL_ALIGN, TG_POOL_STORAGE_SIZE(capacity ? capacity : 1));
+    if (storage == NULL) {
+        free(pool);
+        return NULL;
+    }
+    tg_pool_init(pool, storage, TG_POOL_STORAGE_SIZE(capacity));
+    pool->owns_storage = true;
+    return pool;
+}
+
+/**
+ * Free a pool from tg_pool_create(). Games still acquired from it 
+ * become invalid
+*/
+void tg_pool_destroy(TetrisGamePool *pool) {
+    if (pool == NULL)
+        return;
+    if (pool->owns_storage)
+        free(pool->storage);
+    free(pool);
+}
+
+/**
+ * Take a free slot and start a new game in it, as create_game_seeded()
+ * @returns game, or NULL if every slot is in use
+*/
+TetrisGame *tg_pool_acquire(TetrisGamePool *pool, uint64_t seed) {
+    if (pool->free_head == TG_POOL_NONE)
+        return NULL;
+
+    uint8_t *slot = slot_ptr(pool, pool->free_head);
+    memcpy(&pool->free_head, slot, sizeof(pool->free_head));
+    pool->in_use++;
+    return create_game_seeded_in(slot, seed);
+}
+
+/**
+ * End a game from tg_pool_acquire() and put its slot back on the free stack
+*/
+void tg_pool_release(TetrisGamePool *pool, TetrisGame *tg) {
+    uint8_t *slot = (uint8_t*) tg;
+    assert(slot >= pool->storage && slot < slot_ptr(pool, pool->capacity) && \
+        (size_t) (slot - pool->storage) % TG_POOL_SLOT_SIZE == 0 && \
+        "game isn't from this pool");
+
+    end_game_in(tg);
+    uint32_t idx = (slot - pool->storage) / TG_POOL_SLOT_SIZE;
+    memcpy(slot, &pool->free_head, sizeof(pool->free_head));
+    pool->free_head = idx;
+    pool->in_use--;
+}
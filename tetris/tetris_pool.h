@@ -0,0 +1,48 @@
+/**
+ * Fixed-size pool of TetrisGame instances for the tetris game library
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#ifndef TETRIS_POOL_H
+#define TETRIS_POOL_H
+
+#include "tetris.h"
+
+// every slot starts on its own cache line, so games on different
+//  threads never share one
+#define TG_POOL_ALIGN 64
+#define TG_POOL_SLOT_SIZE \
+    ((sizeof(TetrisGame) + TG_POOL_ALIGN - 1) / TG_POOL_ALIGN * TG_POOL_ALIGN)
+// bytes of storage tg_pool_init() needs for `n` games, eg for a static buffer:
+//  static _Alignas(TG_POOL_ALIGN) uint8_t buf[TG_POOL_STORAGE_SIZE(4)];
+#define TG_POOL_STORAGE_SIZE(n) ((size_t) (n) * TG_POOL_SLOT_SIZE)
+
+#define TG_POOL_NONE UINT32_MAX
+
+/**
+ * Games stored back to back in one block, with free slots chained through 
+ * their own first bytes so acquire and release are O(1) with no other 
+ * bookkeeping. Not thread safe; give each thread its own pool
+ * @param storage TG_POOL_ALIGN aligned block of capacity slots
+ * @param capacity number of slots
+ * @param in_use number of acquired slots
+ * @param free_head first free slot, TG_POOL_NONE if the pool is full
+ * @param owns_storage true if tg_pool_create() allocated storage
+*/
+typedef struct TetrisGamePool {
+    uint8_t *storage;
+    uint32_t capacity;
+    uint32_t in_use;
+    uint32_t free_head;
+    bool owns_storage;
+} TetrisGamePool;
+
+
+TetrisGamePool *tg_pool_create(uint32_t capacity);
+void tg_pool_init(TetrisGamePool *pool, void *storage, size_t storage_size);
+void tg_pool_destroy(TetrisGamePool *pool);
+TetrisGame *tg_pool_acquire(TetrisGamePool *pool, uint64_t seed);
+void tg_pool_release(TetrisGamePool *pool, TetrisGame *tg);
+
+#endif
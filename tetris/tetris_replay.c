@@ -0,0 +1,268 @@
+/**
+ * Replay recording and playback
+ * @brief Records a game as its setup plus a varint stream of the ticks 
+ *  where the player did something, and re-executes it headless at full 
+ *  speed. Games are rebuilt from the seed and run on the frame clock, so 
+ *  the piece sequence and gravity ticks come out bit-exact, and the final 
+ *  score, level, and board hash stored at the end of the stream confirm it.
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#include "tetris_replay.h"
+
+#define REPLAY_INITIAL_CAP 256
+// longest LEB128 encoding of a uint64_t
+#define VARINT_MAX_BYTES 10
+
+
+/////////////// STREAM ENCODING ////////////////
+
+static bool stream_reserve(TetrisReplay *rp, size_t extra) {
+    if (rp->failed)
+        return false;
+    if (rp->len + extra <= rp->cap)
+        return true;
+
+    size_t cap = rp->cap ? rp->cap : REPLAY_INITIAL_CAP;
+    while (cap < rp->len + extra)
+        cap *= 2;
+    uint8_t *data = realloc(rp->data, cap);
+    if (data == NULL) {
+        rp->failed = true;
+        return false;
+    }
+    rp->data = data;
+    rp->cap = cap;
+    return true;
+}
+
+static void stream_put_varint(TetrisReplay *rp, uint64_t v) {
+    if (!stream_reserve(rp, VARINT_MAX_BYTES))
+        return;
+    do {
+        uint8_t byte = v & 0x7F;
+        v >>= 7;
+        rp->data[rp->len++] = byte | (v ? 0x80 : 0);
+    } while (v);
+}
+
+static void put_le(uint8_t *out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static uint64_t get_le(const uint8_t *in, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++)
+        v |= (uint64_t) in[i] << (8 * i);
+    return v;
+}
+
+/**
+ * Read a varint at *pos, advancing it
+ * @returns false if the stream ends mid-varint or the value overflows
+*/
+static bool stream_get_varint(const uint8_t *data, size_t len, size_t *pos, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 7 * VARINT_MAX_BYTES; shift += 7) {
+        if (*pos >= len)
+            return false;
+        uint8_t byte = data[(*pos)++];
+        *v |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+
+/////////////// RECORDING ////////////////
+
+/**
+ * Create the game a replay starts from. Recording and playback both 
+ * set games up through here, so they always start identically
+*/
+TetrisGame *replay_create_game(const TetrisReplay *rp) {
+    TetrisGame *tg = create_game_seeded(rp->seed);
+    tg_set_randomizer(tg, rp->randomizer);
+    tg_set_frame_clock(tg, rp->frame_usec);
+    create_rand_piece(tg);
+    return tg;
+}
+
+/**
+ * Start recording a new game
+ * @returns the game to play, pass every move for it through replay_tick()
+*/
+TetrisGame *replay_start(TetrisReplay *rp, uint64_t seed, enum tetris_randomizer randomizer, \
+    uint32_t frame_usec) {
+    memset(rp, 0, sizeof(TetrisReplay));
+    rp->seed = seed;
+    rp->randomizer = randomizer;
+    rp->frame_usec = frame_usec;
+    stream_reserve(rp, REPLAY_INITIAL_CAP);
+    return replay_create_game(rp);
+}
+
+/**
+ * Record `move` and run it through tg_tick()
+ * @returns tg_tick()'s result
+*/
+bool replay_tick(TetrisReplay *rp, TetrisGame *tg, enum player_move move) {
+    assert(!rp->finished && move != T_PLAYPAUSE && move != T_QUIT);
+
+    if (move != T_NONE) {
+        stream_put_varint(rp, ((rp->ticks - rp->idle_since) << TG_REPLAY_MOVE_BITS) | move);
+        rp->idle_since = rp->ticks + 1;
+    }
+    rp->ticks++;
+    return tg_tick(tg, move);
+}
+
+/**
+ * Close the stream with the end marker and the game's final state
+ * @returns false if the recording is incomplete because memory ran out
+*/
+bool replay_finish(TetrisReplay *rp, const TetrisGame *tg) {
+    assert(!rp->finished);
+    stream_put_varint(rp, ((rp->ticks - rp->idle_since) << TG_REPLAY_MOVE_BITS) | T_NONE);
+    if (stream_reserve(rp, 16)) {
+        put_le(rp->data + rp->len, tg->score, 4);
+        put_le(rp->data + rp->len + 4, tg->level, 4);
+        put_le(rp->data + rp->len + 8, tg->board.hash, 8);
+        rp->len += 16;
+    }
+    rp->finished = true;
+    return !rp->failed;
+}
+
+void replay_free(TetrisReplay *rp) {
+    free(rp->data);
+    rp->data = NULL;
+    rp->len = rp->cap = 0;
+}
+
+
+/////////////// FILES ////////////////
+
+/**
+ * Write a finished replay to `filename`
+ * @returns false on write errors
+*/
+bool replay_save(const TetrisReplay *rp, const char *filename) {
+    assert(rp->finished);
+    if (rp->failed || rp->len > UINT32_MAX)
+        return false;
+
+    uint8_t header[TG_REPLAY_HEADER_SIZE];
+    memcpy(header, TG_REPLAY_MAGIC, 4);
+    header[4] = TG_REPLAY_VERSION;
+    header[5] = TETRIS_ROWS;
+    header[6] = TETRIS_COLS;
+    header[7] = rp->randomizer;
+    put_le(header + 8, rp->seed, 8);
+    put_le(header + 16, rp->frame_usec, 4);
+    put_le(header + 20, rp->len, 4);
+
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL)
+        return false;
+    bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header) && \
+        fwrite(rp->data, 1, rp->len, f) == rp->len;
+    return (fclose(f) == 0) && ok;
+}
+
+/**
+ * Read a replay saved by replay_save(). Replays recorded on a different 
+ * board size or format version are rejected
+ * @returns false if the file can't be read or isn't a compatible replay
+*/
+bool replay_load(TetrisReplay *rp, const char *filename) {
+    memset(rp, 0, sizeof(TetrisReplay));
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL)
+        return false;
+
+    uint8_t header[TG_REPLAY_HEADER_SIZE];
+    bool ok = fread(header, 1, sizeof(header), f) == sizeof(header) && \
+        memcmp(header, TG_REPLAY_MAGIC, 4) == 0 && header[4] == TG_REPLAY_VERSION && \
+        header[5] == TETRIS_ROWS && header[6] == TETRIS_COLS && header[7] <= TG_RANDOM_7BAG;
+    if (ok) {
+        rp->randomizer = header[7];
+        rp->seed = get_le(header + 8, 8);
+        rp->frame_usec = get_le(header + 16, 4);
+        size_t len = get_le(header + 20, 4);
+        ok = stream_reserve(rp, len ? len : 1) && fread(rp->data, 1, len, f) == len;
+        rp->len = len;
+        rp->finished = true;
+    }
+    fclose(f);
+    if (!ok)
+        replay_free(rp);
+    return ok;
+}
+
+
+/////////////// PLAYBACK ////////////////
+
+/**
+ * Re-execute a finished replay headless, as fast as the game runs, and 
+ * compare how it ends against the recording
+*/
+TetrisReplayResult replay_run(const TetrisReplay *rp) {
+    TetrisReplayResult res = {.status = REPLAY_CORRUPT};
+    if (!rp->finished || rp->failed)
+        return res;
+
+    TetrisGame *tg = replay_create_game(rp);
+    size_t pos = 0;
+    uint64_t entry;
+    bool corrupt = false;
+    bool running = true;
+
+    while (true) {
+        if (!stream_get_varint(rp->data, rp->len, &pos, &entry)) {
+            corrupt = true;
+            break;
+        }
+        enum player_move move = entry & ((1 << TG_REPLAY_MOVE_BITS) - 1);
+        uint64_t delta = entry >> TG_REPLAY_MOVE_BITS;
+        if (move == T_PLAYPAUSE || move == T_QUIT) {
+            corrupt = true;
+            break;
+        }
+
+        // idle ticks up to this entry, then its move. The recording stops 
+        //  at game over, so a tick past it means the stream is bad
+        uint64_t ticks = delta + (move != T_NONE);
+        if (ticks > TG_REPLAY_MAX_TICKS - res.ticks) {
+            corrupt = true;
+            break;
+        }
+        for (uint64_t i = 0; i < ticks; i++) {
+            if (!running) {
+                corrupt = true;
+                break;
+            }
+            running = tg_tick(tg, i < delta ? T_NONE : move);
+            res.ticks++;
+        }
+        if (corrupt || move == T_NONE)
+            break;      // T_NONE is the end marker
+    }
+
+    if (!corrupt && rp->len - pos == 16) {
+        res.expected_score = get_le(rp->data + pos, 4);
+        res.expected_level = get_le(rp->data + pos + 4, 4);
+        res.expected_hash = get_le(rp->data + pos + 8, 8);
+        res.score = tg->score;
+        res.level = tg->level;
+        res.hash = tg->board.hash;
+        res.status = (res.score == res.expected_score && res.level == res.expected_level && \
+            res.hash == res.expected_hash) ? REPLAY_OK : REPLAY_MISMATCH;
+    }
+
+    end_game(tg);
+    return res;
+}
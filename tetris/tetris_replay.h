@@ -0,0 +1,93 @@
+/**
+ * Binary replay recording and playback for the tetris game library
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#ifndef TETRIS_REPLAY_H
+#define TETRIS_REPLAY_H
+
+#include "tetris.h"
+
+#define TG_REPLAY_MAGIC "TGRP"
+// 2: final board hash uses per-row Zobrist keys
+#define TG_REPLAY_VERSION 2
+// file header: magic, version, rows, cols, randomizer, seed, frame_usec, stream length
+#define TG_REPLAY_HEADER_SIZE (4 + 4 + 8 + 4 + 4)
+
+// moves are packed in the low bits of each stream entry
+#define TG_REPLAY_MOVE_BITS 3
+static_assert(T_HARDDROP < (1 << TG_REPLAY_MOVE_BITS), "player_move doesn't fit in a replay entry");
+// most ticks replay_run() will play back, so a corrupt delta can't spin forever
+#define TG_REPLAY_MAX_TICKS UINT32_MAX
+
+/**
+ * A recorded game: how it was set up, plus every move that wasn't T_NONE.
+ * The stream is a sequence of LEB128 varints, (T_NONE ticks since the 
+ * previous move << TG_REPLAY_MOVE_BITS) | move. A T_NONE entry marks the end 
+ * of the game, with its count running to the last tick, and is followed by the 
+ * final score, level (both uint32_t) and board hash (uint64_t), little endian
+ * @param seed rng seed the game started from
+ * @param randomizer piece randomizer mode
+ * @param frame_usec frame clock period; replays run on the frame clock so 
+ *  gravity lands on the same ticks every time
+ * @param data encoded stream
+ * @param len bytes used in data
+ * @param cap bytes allocated for data
+ * @param ticks ticks recorded so far
+ * @param idle_since first tick after the last recorded move
+ * @param finished true once the end marker and final state are written
+ * @param failed true if the stream couldn't grow, the recording is incomplete
+*/
+typedef struct TetrisReplay {
+    uint64_t seed;
+    enum tetris_randomizer randomizer;
+    uint32_t frame_usec;
+
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+
+    uint64_t ticks;
+    uint64_t idle_since;
+    bool finished;
+    bool failed;
+} TetrisReplay;
+
+/**
+ * Result of replay_run()
+ * REPLAY_OK - game ended with the recorded score, level, and board
+ * REPLAY_MISMATCH - replay ran, but the game ended differently than recorded
+ * REPLAY_CORRUPT - stream is truncated, unfinished, or malformed, has moves 
+ *  after the game ended, or runs past TG_REPLAY_MAX_TICKS
+*/
+enum replay_status {REPLAY_OK, REPLAY_MISMATCH, REPLAY_CORRUPT};
+
+/**
+ * Final state of a replayed game, as recorded and as reproduced
+*/
+typedef struct TetrisReplayResult {
+    enum replay_status status;
+    uint64_t ticks;
+    uint32_t expected_score;
+    uint32_t score;
+    uint32_t expected_level;
+    uint32_t level;
+    uint64_t expected_hash;
+    uint64_t hash;
+} TetrisReplayResult;
+
+
+TetrisGame *replay_start(TetrisReplay *rp, uint64_t seed, enum tetris_randomizer randomizer, \
+    uint32_t frame_usec);
+bool replay_tick(TetrisReplay *rp, TetrisGame *tg, enum player_move move);
+bool replay_finish(TetrisReplay *rp, const TetrisGame *tg);
+void replay_free(TetrisReplay *rp);
+
+bool replay_save(const TetrisReplay *rp, const char *filename);
+bool replay_load(TetrisReplay *rp, const char *filename);
+
+TetrisGame *replay_create_game(const TetrisReplay *rp);
+TetrisReplayResult replay_run(const TetrisReplay *rp);
+
+#endif
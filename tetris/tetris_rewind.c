@@ -0,0 +1,150 @@
+/**
+ * Rewind ring
+ * @brief Keeps the game state from the last few piece spawns so a game
+ *  can be stepped back to before its recent placements, for undo or for
+ *  retrying a position. Entries store the board as row masks plus the
+ *  colors of filled cells, well under half the size of the two int8_t 
+ *  boards a TetrisGame carries.
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#include "tetris_rewind.h"
+
+
+/**
+ * Start keeping the last `capacity` spawns of `tg`, beginning with its
+ * current piece. Calling again with a new capacity drops the old history
+ * @returns false if capacity is 0 or the ring can't be allocated
+*/
+bool tg_enable_rewind(TetrisGame *tg, uint16_t capacity) {
+    if (capacity == 0)
+        return false;
+
+    TetrisRewind *rw = malloc(sizeof(TetrisRewind) + capacity * sizeof(TetrisRewindEntry));
+    if (rw == NULL)
+        return false;
+    rw->capacity = capacity;
+    rw->count = 0;
+    rw->head = 0;
+
+    tg_disable_rewind(tg);
+    tg->rewind = rw;
+    tg_rewind_record(tg);
+    return true;
+}
+
+/**
+ * Stop keeping rewind history and free it. Safe to call when it's off
+*/
+void tg_disable_rewind(TetrisGame *tg) {
+    free(tg->rewind);
+    tg->rewind = NULL;
+}
+
+/**
+ * Forget all recorded spawns, eg after loading a different game into `tg`
+*/
+void tg_rewind_clear(TetrisGame *tg) {
+    if (tg->rewind) {
+        tg->rewind->count = 0;
+        tg->rewind->head = 0;
+    }
+}
+
+/**
+ * Record the current state of `tg` as the newest entry. Called by
+ * create_rand_piece() whenever rewind is enabled, so every entry has the
+ * active piece at its spawn position
+*/
+void tg_rewind_record(TetrisGame *tg) {
+    TetrisRewind *rw = tg->rewind;
+    TetrisRewindEntry *e = &rw->entries[rw->head];
+
+    memset(e->colors, 0, sizeof(e->colors));
+    uint32_t bit = 0;
+    for (int row = 0; row < TETRIS_ROWS; row++) {
+        uint32_t mask = (TETRIS_ROW_MASK(&tg->board, row) >> TETRIS_BOARD_PAD) & \
+            ((1u << TETRIS_COLS) - 1);
+        e->occupancy[row] = mask;
+        for (; mask; mask &= mask - 1) {
+            int col = __builtin_ctz(mask);
+            uint32_t color = (uint8_t) tg->board.board[row][col];
+            assert(color < (1u << TG_REWIND_COLOR_BITS));
+            // 3 bit fields can straddle a byte boundary
+            uint16_t packed = color << (bit % 8);
+            e->colors[bit / 8] |= packed & 0xFF;
+            if (packed >> 8)
+                e->colors[bit / 8 + 1] |= packed >> 8;
+            bit += TG_REWIND_COLOR_BITS;
+        }
+    }
+
+    e->highest_occupied_cell = tg->board.highest_occupied_cell;
+    e->lines_cleared_since_last_level = tg->lines_cleared_since_last_level;
+    e->piece = tg->active_piece;
+    e->rng = tg->rng;
+    e->score = tg->score;
+    e->level = tg->level;
+    e->gravity_tick_rate_usec = tg->gravity_tick_rate_usec;
+
+    rw->head = (rw->head + 1) % rw->capacity;
+    if (rw->count < rw->capacity)
+        rw->count++;
+}
+
+/**
+ * Number of placements tg_rewind() can currently undo
+*/
+uint16_t tg_rewind_available(const TetrisGame *tg) {
+    return (tg->rewind && tg->rewind->count > 0) ? tg->rewind->count - 1 : 0;
+}
+
+/**
+ * Step `tg` back `k` placements, to when the piece `k` spawns ago appeared.
+ * k = 0 puts the current piece back at its spawn position. The pieces dealt
+ * afterwards come out the same again, since the randomizer is restored too.
+ * Entries newer than the restored one are dropped, so rewinding again
+ * keeps going further back. Gravity restarts from the current clock time
+ * @returns false, leaving `tg` untouched, if rewind is off or fewer than
+ *  `k` placements are recorded
+*/
+bool tg_rewind(TetrisGame *tg, uint16_t k) {
+    TetrisRewind *rw = tg->rewind;
+    if (rw == NULL || k >= rw->count)
+        return false;
+
+    // drop the k newest entries, the restored one stays as the newest
+    rw->head = (rw->head + rw->capacity - k) % rw->capacity;
+    rw->count -= k;
+    const TetrisRewindEntry *e = &rw->entries[(rw->head + rw->capacity - 1) % rw->capacity];
+
+    uint32_t bit = 0;
+    for (int row = 0; row < TETRIS_ROWS; row++) {
+        for (int col = 0; col < TETRIS_COLS; col++) {
+            if (!(e->occupancy[row] & (1u << col))) {
+                tg->board.board[row][col] = BG_COLOR;
+                continue;
+            }
+            uint16_t packed = e->colors[bit / 8];
+            if (bit % 8 + TG_REWIND_COLOR_BITS > 8)
+                packed |= e->colors[bit / 8 + 1] << 8;
+            tg->board.board[row][col] = (packed >> (bit % 8)) & ((1u << TG_REWIND_COLOR_BITS) - 1);
+            bit += TG_REWIND_COLOR_BITS;
+        }
+    }
+    rebuild_board_occupancy(&tg->board);
+    tg->board.highest_occupied_cell = e->highest_occupied_cell;
+
+    tg->lines_cleared_since_last_level = e->lines_cleared_since_last_level;
+    tg->active_piece = e->piece;
+    tg->rng = e->rng;
+    tg->score = e->score;
+    tg->level = e->level;
+    tg->gravity_tick_rate_usec = e->gravity_tick_rate_usec;
+    tg->game_over = false;
+    tg->last_gravity_tick_usec = tg_clock_now_usec(tg);
+    tg_board_changed(tg);
+
+    return true;
+}
@@ -0,0 +1,60 @@
+/**
+ * Rewinding recent placements for the tetris game library
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#ifndef TETRIS_REWIND_H
+#define TETRIS_REWIND_H
+
+#include "tetris.h"
+
+// bits per stored cell color, enough for every piece_type
+#define TG_REWIND_COLOR_BITS 3
+static_assert(NUM_TETROMINOS <= (1 << TG_REWIND_COLOR_BITS), "piece colors don't fit the rewind color bits");
+#define TG_REWIND_COLOR_BYTES ((TETRIS_ROWS * TETRIS_COLS * TG_REWIND_COLOR_BITS + 7) / 8)
+
+/**
+ * Game state as a piece spawned. The board is kept as one occupancy mask
+ * per row plus the colors of only the occupied cells, packed
+ * TG_REWIND_COLOR_BITS each in row-major order, instead of a full int8_t
+ * board. Everything else is rebuilt by tg_rewind()
+ * @param occupancy per row, bit `col` set if the cell is filled
+ * @param colors piece_type of each filled cell, in order
+ * @param piece active piece at its spawn position
+ * @param rng piece randomizer right after `piece` was drawn
+*/
+typedef struct TetrisRewindEntry {
+    uint32_t occupancy[TETRIS_ROWS];
+    uint8_t colors[TG_REWIND_COLOR_BYTES];
+    uint8_t highest_occupied_cell;
+    uint8_t lines_cleared_since_last_level;
+    TetrisPiece piece;
+    TetrisRng rng;
+    uint32_t score;
+    uint32_t level;
+    uint32_t gravity_tick_rate_usec;
+} TetrisRewindEntry;
+
+/**
+ * Ring of the last `capacity` spawns, oldest overwritten first
+ * @param capacity number of entries
+ * @param count entries recorded, at most capacity
+ * @param head index the next entry is written to
+*/
+typedef struct TetrisRewind {
+    uint16_t capacity;
+    uint16_t count;
+    uint16_t head;
+    TetrisRewindEntry entries[];
+} TetrisRewind;
+
+
+bool tg_enable_rewind(TetrisGame *tg, uint16_t capacity);
+void tg_disable_rewind(TetrisGame *tg);
+void tg_rewind_clear(TetrisGame *tg);
+void tg_rewind_record(TetrisGame *tg);
+uint16_t tg_rewind_available(const TetrisGame *tg);
+bool tg_rewind(TetrisGame *tg, uint16_t k);
+
+#endif
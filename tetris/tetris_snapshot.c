@@ -0,0 +1,180 @@
+/**
+ * Binary game snapshots
+ * @brief Versioned, fixed-layout alternative to the INI saves in utils.c. 
+ *  Saving and loading is a struct copy plus rebuilding the derived board 
+ *  state, with no text formatting or parsing.
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#include "tetris_snapshot.h"
+#include "tetris_rewind.h"
+
+
+/**
+ * Take a snapshot of `tg`
+*/
+void tg_snapshot_save(const TetrisGame *tg, TetrisSnapshot *snap) {
+    memset(snap, 0, sizeof(TetrisSnapshot));
+    memcpy(snap->magic, TG_SNAPSHOT_MAGIC, sizeof(snap->magic));
+    snap->endian = TG_SNAPSHOT_ENDIAN_TAG;
+    snap->version = TG_SNAPSHOT_VERSION;
+    snap->rows = TETRIS_ROWS;
+    snap->cols = TETRIS_COLS;
+    snap->size = sizeof(TetrisSnapshot);
+
+    snap->seed = tg->seed;
+    snap->last_gravity_tick_usec = tg->last_gravity_tick_usec;
+    snap->virtual_usec = tg->clock.virtual_usec;
+    snap->score = tg->score;
+    snap->level = tg->level;
+    snap->gravity_tick_rate_usec = tg->gravity_tick_rate_usec;
+    snap->frame_usec = tg->clock.frame_usec;
+
+    memcpy(snap->rng_s, tg->rng.s, sizeof(snap->rng_s));
+    // an empty bag's contents are never read, keep them out of the snapshot
+    if (tg->rng.bag_idx < NUM_TETROMINOS)
+        memcpy(snap->rng_bag, tg->rng.bag, sizeof(snap->rng_bag));
+    snap->rng_bag_idx = tg->rng.bag_idx;
+    snap->rng_mode = tg->rng.mode;
+    snap->clock_source = tg->clock.source;
+    snap->game_over = tg->game_over;
+    snap->lines_cleared_since_last_level = tg->lines_cleared_since_last_level;
+
+    snap->piece_ptype = tg->active_piece.ptype;
+    snap->piece_orientation = tg->active_piece.orientation;
+    snap->piece_falling = tg->active_piece.falling;
+    snap->piece_row = tg->active_piece.loc.row;
+    snap->piece_col = tg->active_piece.loc.col;
+    snap->board_highest_occupied_cell = tg->board.highest_occupied_cell;
+    snap->active_board_highest_occupied_cell = tg->active_board.highest_occupied_cell;
+
+    memcpy(snap->board, tg->board.board, sizeof(snap->board));
+    memcpy(snap->active_board, tg->active_board.board, sizeof(snap->active_board));
+}
+
+/**
+ * Helper to check every cell of a snapshot board is empty or a piece type
+*/
+static bool snapshot_cells_valid(const int8_t cells[TETRIS_ROWS][TETRIS_COLS]) {
+    for (int row = 0; row < TETRIS_ROWS; row++)
+        for (int col = 0; col < TETRIS_COLS; col++)
+            if (cells[row][col] != BG_COLOR && (cells[row][col] < 0 || cells[row][col] >= NUM_TETROMINOS))
+                return false;
+    return true;
+}
+
+/**
+ * Check a snapshot was written by this version of the format, on a 
+ * machine with the same byte order, for the same board size, and that 
+ * everything the game indexes with is in range: enums, the undealt bag, the 
+ * active piece's cells, highest occupied rows and board cells. A snapshot 
+ * from a file can't be trusted to be one tg_snapshot_save() wrote
+*/
+bool tg_snapshot_valid(const TetrisSnapshot *snap) {
+    if (!(memcmp(snap->magic, TG_SNAPSHOT_MAGIC, sizeof(snap->magic)) == 0 && \
+        snap->endian == TG_SNAPSHOT_ENDIAN_TAG && snap->version == TG_SNAPSHOT_VERSION && \
+        snap->rows == TETRIS_ROWS && snap->cols == TETRIS_COLS && \
+        snap->size == sizeof(TetrisSnapshot) && snap->piece_ptype < NUM_TETROMINOS && \
+        snap->piece_orientation < NUM_ORIENTATIONS && snap->rng_mode <= TG_RANDOM_7BAG && \
+        snap->clock_source <= TG_CLOCK_CUSTOM && snap->rng_bag_idx <= NUM_TETROMINOS && \
+        snap->board_highest_occupied_cell < TETRIS_ROWS && \
+        snap->active_board_highest_occupied_cell < TETRIS_ROWS))
+        return false;
+
+    // only the pieces still to be dealt are ever read
+    for (int i = snap->rng_bag_idx; i < NUM_TETROMINOS; i++)
+        if (snap->rng_bag[i] >= NUM_TETROMINOS)
+            return false;
+
+    TetrisPiece tp = {.ptype = snap->piece_ptype, .orientation = snap->piece_orientation, \
+        .loc = {.row = snap->piece_row, .col = snap->piece_col}};
+    if (!piece_on_board(tp))
+        return false;
+
+    return snapshot_cells_valid(snap->board) && snapshot_cells_valid(snap->active_board);
+}
+
+/**
+ * Restore `tg` from a snapshot. A snapshot taken on a custom clock keeps 
+ * whatever custom clock `tg` already has, since callbacks aren't saved; 
+ * if `tg` has none, it goes on a virtual clock at the snapshot's time 
+ * instead. Any rewind history is cleared, as it belonged to the old game
+ * @returns false, leaving `tg` untouched, if the snapshot isn't valid
+*/
+bool tg_snapshot_load(TetrisGame *tg, const TetrisSnapshot *snap) {
+    if (!tg_snapshot_valid(snap))
+        return false;
+
+    tg->seed = snap->seed;
+    tg->last_gravity_tick_usec = snap->last_gravity_tick_usec;
+    tg->score = snap->score;
+    tg->level = snap->level;
+    tg->gravity_tick_rate_usec = snap->gravity_tick_rate_usec;
+    tg->game_over = snap->game_over;
+    tg->lines_cleared_since_last_level = snap->lines_cleared_since_last_level;
+
+    if (snap->clock_source != TG_CLOCK_CUSTOM) {
+        tg->clock.source = snap->clock_source;
+        tg->clock.now_fn = NULL;
+        tg->clock.ctx = NULL;
+    } else if (tg->clock.source != TG_CLOCK_CUSTOM) {
+        // no callback to restore, a NULL now_fn would crash the next tick
+        tg->clock.source = TG_CLOCK_VIRTUAL;
+        tg->clock.now_fn = NULL;
+        tg->clock.ctx = NULL;
+    }
+    tg->clock.virtual_usec = snap->virtual_usec;
+    tg->clock.frame_usec = snap->frame_usec;
+
+    memcpy(tg->rng.s, snap->rng_s, sizeof(tg->rng.s));
+    memcpy(tg->rng.bag, snap->rng_bag, sizeof(tg->rng.bag));
+    tg->rng.bag_idx = snap->rng_bag_idx;
+    tg->rng.mode = snap->rng_mode;
+
+    tg->active_piece.ptype = snap->piece_ptype;
+    tg->active_piece.orientation = snap->piece_orientation;
+    tg->active_piece.falling = snap->piece_falling;
+    tg->active_piece.loc.row = snap->piece_row;
+    tg->active_piece.loc.col = snap->piece_col;
+
+    memcpy(tg->board.board, snap->board, sizeof(snap->board));
+    memcpy(tg->active_board.board, snap->active_board, sizeof(snap->active_board));
+    rebuild_board_occupancy(&tg->board);
+    rebuild_board_occupancy(&tg->active_board);
+    tg->board.highest_occupied_cell = snap->board_highest_occupied_cell;
+    tg->active_board.highest_occupied_cell = snap->active_board_highest_occupied_cell;
+    tg_board_changed(tg);
+    tg_rewind_clear(tg);
+
+    return true;
+}
+
+/**
+ * Write a snapshot of `tg` to `filename`
+ * @returns false on write errors
+*/
+bool tg_snapshot_write_file(const TetrisGame *tg, const char *filename) {
+    TetrisSnapshot snap;
+    tg_snapshot_save(tg, &snap);
+
+    FILE *f = fopen(filename, "wb");
+    if (f == NULL)
+        return false;
+    bool ok = fwrite(&snap, sizeof(snap), 1, f) == 1;
+    return (fclose(f) == 0) && ok;
+}
+
+/**
+ * Restore `tg` from the first snapshot in `filename`
+ * @returns false if the file can't be read or isn't a valid snapshot
+*/
+bool tg_snapshot_read_file(TetrisGame *tg, const char *filename) {
+    TetrisSnapshot snap;
+    FILE *f = fopen(filename, "rb");
+    if (f == NULL)
+        return false;
+    bool ok = fread(&snap, sizeof(snap), 1, f) == 1;
+    fclose(f);
+    return ok && tg_snapshot_load(tg, &snap);
+}
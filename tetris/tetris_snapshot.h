@@ -0,0 +1,79 @@
+/**
+ * Binary game snapshots for the tetris game library
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#ifndef TETRIS_SNAPSHOT_H
+#define TETRIS_SNAPSHOT_H
+
+#include "tetris.h"
+
+#define TG_SNAPSHOT_MAGIC "TGSS"
+#define TG_SNAPSHOT_VERSION 1
+// written in native byte order; a file from a machine with the other 
+//  byte order reads this back scrambled and is rejected
+#define TG_SNAPSHOT_ENDIAN_TAG 0x01020304u
+
+/**
+ * Fixed-layout image of a TetrisGame, with no pointers or interior padding, 
+ * so a file of them can be read with one read() or mmapped and used in 
+ * place. Snapshots are all the same size, so a corpus is just snapshots 
+ * written back to back and indexed as an array. Everything besides the 
+ * derived board state (occupancy masks, column metrics, hash), which is 
+ * rebuilt on load, and a custom clock's callback
+ * @param magic TG_SNAPSHOT_MAGIC
+ * @param endian TG_SNAPSHOT_ENDIAN_TAG
+ * @param version TG_SNAPSHOT_VERSION
+ * @param rows, cols board dimensions the snapshot was taken with
+ * @param size sizeof(TetrisSnapshot) when written
+*/
+typedef struct TetrisSnapshot {
+    char magic[4];
+    uint32_t endian;
+    uint16_t version;
+    uint8_t rows;
+    uint8_t cols;
+    uint32_t size;
+
+    uint64_t seed;
+    uint64_t last_gravity_tick_usec;
+    uint64_t virtual_usec;
+    uint32_t score;
+    uint32_t level;
+    uint32_t gravity_tick_rate_usec;
+    uint32_t frame_usec;
+
+    uint32_t rng_s[4];
+    uint8_t rng_bag[NUM_TETROMINOS];
+    uint8_t rng_bag_idx;
+    uint8_t rng_mode;
+    uint8_t clock_source;
+    uint8_t game_over;
+    uint8_t lines_cleared_since_last_level;
+
+    uint8_t piece_ptype;
+    uint8_t piece_orientation;
+    uint8_t piece_falling;
+    int8_t piece_row;
+    int8_t piece_col;
+    uint8_t board_highest_occupied_cell;
+    uint8_t active_board_highest_occupied_cell;
+    uint8_t reserved[5];
+
+    int8_t board[TETRIS_ROWS][TETRIS_COLS];
+    int8_t active_board[TETRIS_ROWS][TETRIS_COLS];
+} TetrisSnapshot;
+
+static_assert(offsetof(TetrisSnapshot, board) == 96 && \
+    offsetof(TetrisSnapshot, active_board) == 96 + TETRIS_ROWS * TETRIS_COLS, \
+    "TetrisSnapshot layout has padding");
+
+
+void tg_snapshot_save(const TetrisGame *tg, TetrisSnapshot *snap);
+bool tg_snapshot_valid(const TetrisSnapshot *snap);
+bool tg_snapshot_load(TetrisGame *tg, const TetrisSnapshot *snap);
+bool tg_snapshot_write_file(const TetrisGame *tg, const char *filename);
+bool tg_snapshot_read_file(TetrisGame *tg, const char *filename);
+
+#endif
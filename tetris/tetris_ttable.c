@@ -0,0 +1,71 @@
+/**
+ * Lock-free transposition table
+ * @brief Maps Zobrist state keys (tt_state_key()) to caller data, so search 
+ *  and analysis tools can memoize work on stacks they've already seen. 
+ *  Slots are two 64 bit words written with relaxed atomics and no locks; 
+ *  the first word is key ^ data, so a probe only hits when both words came 
+ *  from the same store.
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#include "tetris_ttable.h"
+
+
+/**
+ * Allocate an empty table with 2^log2_entries slots
+ * @returns table, or NULL if allocation failed
+*/
+TetrisTTable *tt_create(uint8_t log2_entries) {
+    assert(log2_entries <= TT_MAX_LOG2_ENTRIES);
+
+    TetrisTTable *tt = malloc(sizeof(TetrisTTable));
+    if (tt == NULL)
+        return NULL;
+    tt->mask = (1ULL << log2_entries) - 1;
+    tt->entries = malloc((tt->mask + 1) * sizeof(TetrisTTEntry));
+    if (tt->entries == NULL) {
+        free(tt);
+        return NULL;
+    }
+    tt_clear(tt);
+    return tt;
+}
+
+void tt_destroy(TetrisTTable *tt) {
+    if (tt == NULL)
+        return;
+    free(tt->entries);
+    free(tt);
+}
+
+/**
+ * Empty every slot. Not safe to run alongside probes and stores
+*/
+void tt_clear(TetrisTTable *tt) {
+    for (uint64_t i = 0; i <= tt->mask; i++) {
+        // an empty slot reads as key 0, which no real state hashes to in practice
+        atomic_init(&tt->entries[i].check, 0);
+        atomic_init(&tt->entries[i].data, 0);
+    }
+}
+
+void tt_store(TetrisTTable *tt, uint64_t key, uint64_t data) {
+    TetrisTTEntry *e = &tt->entries[key & tt->mask];
+    atomic_store_explicit(&e->check, key ^ data, memory_order_relaxed);
+    atomic_store_explicit(&e->data, data, memory_order_relaxed);
+}
+
+/**
+ * Look up `key`
+ * @returns true and sets *data if the table holds `key`
+*/
+bool tt_probe(const TetrisTTable *tt, uint64_t key, uint64_t *data) {
+    TetrisTTEntry *e = &tt->entries[key & tt->mask];
+    uint64_t check = atomic_load_explicit(&e->check, memory_order_relaxed);
+    uint64_t d = atomic_load_explicit(&e->data, memory_order_relaxed);
+    if ((check ^ d) != key)
+        return false;
+    *data = d;
+    return true;
+}
@@ -0,0 +1,55 @@
+/**
+ * Lock-free transposition table for the tetris game library
+ * @author Jacob Bokor, jacobbokor.com
+ * @date 03/2024
+*/
+
+#ifndef TETRIS_TTABLE_H
+#define TETRIS_TTABLE_H
+
+#include <stdatomic.h>
+
+#include "tetris.h"
+
+#define TT_MAX_LOG2_ENTRIES 30
+
+/**
+ * One slot of the table. `check` holds key ^ data, so a slot torn by two 
+ * threads storing at once fails the key check on probe instead of 
+ * returning another state's data
+*/
+typedef struct TetrisTTEntry {
+    _Atomic uint64_t check;
+    _Atomic uint64_t data;
+} TetrisTTEntry;
+
+/**
+ * Fixed-size table from state keys to 64 bits of caller data. Safe to 
+ * probe and store from any number of threads without locks. Each key 
+ * maps to one slot and a store always replaces what was there, so a 
+ * probe can miss a state that was stored earlier
+ * @param mask number of entries - 1, entries is a power of 2
+ * @param entries slots
+*/
+typedef struct TetrisTTable {
+    uint64_t mask;
+    TetrisTTEntry *entries;
+} TetrisTTable;
+
+
+/**
+ * Key of a board plus the piece about to be placed on it. Rows past the 
+ * bottom of the board are never hashed, so their Zobrist keys are free 
+ * to stand for the piece
+*/
+static inline uint64_t tt_state_key(uint64_t board_hash, enum piece_type ptype, uint8_t orientation) {
+    return board_hash ^ tg_zobrist_key(TETRIS_ROWS + ptype, 1u << orientation);
+}
+
+TetrisTTable *tt_create(uint8_t log2_entries);
+void tt_destroy(TetrisTTable *tt);
+void tt_clear(TetrisTTable *tt);
+void tt_store(TetrisTTable *tt, uint64_t key, uint64_t data);
+bool tt_probe(const TetrisTTable *tt, uint64_t key, uint64_t *data);
+
+#endif